@@ -10,13 +10,46 @@
 #include <algorithm>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <cstring>
+#include <cstdint>
 #include <cmath>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <future>
+#include <chrono>
+#include <ctime>
+#include <tuple>
+#include <type_traits>
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 using namespace std;
 
 
 bool writing_to_file = false;
 bool size_mode = false;
 int globalBlockSize = 256;
+// Dimensões dos painéis empacotados: KC para L1, MC para L2, NC para L3
+const int SIMD_MC = 120;
+const int SIMD_KC = 256;
+const int SIMD_NC = 4080;
+int globalMC = SIMD_MC;
+int globalKC = SIMD_KC;
+int globalNC = SIMD_NC;
 
 void PrintResults(const string &algorithm, int size, int blockSize, int numBlocks, double time, long long L1, long long L2) {
     cout << algorithm << " - Size: " << size;
@@ -63,421 +96,6024 @@ void initialize_matrices(double *matrixA, double *matrixB, double *matrixC, int
     }
 }
 
-void clean_matrices(double *matrixA, double *matrixB, double *matrixC) {
-    free(matrixA);
-    free(matrixB);
-    free(matrixC);
+// Matriz row-major como vista sobre memória da arena (não é dona dos dados)
+struct Matrix {
+    double *data;
+    int rows, cols, ld;
+    double &operator()(int i, int j) { return data[(size_t)i * ld + j]; }
+};
+
+// Arena para as três matrizes A, B e C: é reservada uma vez para o maior N de um varrimento
+// e reutilizada entre kernels, evitando malloc/free e page faults a cada execução.
+// Cada matriz começa num limite de 64 bytes (na prática de página, ou de 2 MB com huge pages).
+class MatrixArena {
+public:
+    bool hugePages = false;
+
+    ~MatrixArena() { release(); }
+
+    // Garante espaço para três matrizes de 'elems' elementos cada
+    void reserve(size_t elems) {
+        size_t align = hugePages ? HUGE_PAGE : (size_t)sysconf(_SC_PAGESIZE);
+        size_t stride = (elems * sizeof(double) + align - 1) / align * align;
+        if (base != nullptr && stride <= strideBytes && allocatedHuge == hugePages)
+            return;
+        release();
+        void *ptr = nullptr;
+        if (posix_memalign(&ptr, max(align, (size_t)64), 3 * stride) != 0) {
+            cerr << "Error allocating matrix arena (" << (3 * stride) / (1024 * 1024) << " MB)" << endl;
+            exit(1);
+        }
+#ifdef MADV_HUGEPAGE
+        if (hugePages && madvise(ptr, 3 * stride, MADV_HUGEPAGE) != 0)
+            cerr << "Warning: madvise(MADV_HUGEPAGE) failed, using regular pages" << endl;
+#endif
+        base = (char *)ptr;
+        strideBytes = stride;
+        allocatedHuge = hugePages;
+    }
+
+    // A é M x K, B é K x N e C é M x N
+    void views(int M, int N, int K, Matrix &A, Matrix &B, Matrix &C) {
+        reserve(max((size_t)M * K, max((size_t)K * N, (size_t)M * N)));
+        A = {(double *)base, M, K, K};
+        B = {(double *)(base + strideBytes), K, N, N};
+        C = {(double *)(base + 2 * strideBytes), M, N, N};
+    }
+
+    void release() {
+        free(base);
+        base = nullptr;
+        strideBytes = 0;
+    }
+
+    size_t bytes() const { return 3 * strideBytes; }
+
+private:
+    static const size_t HUGE_PAGE = 2 * 1024 * 1024;
+    char *base = nullptr;
+    size_t strideBytes = 0;
+    bool allocatedHuge = false;
+};
+
+MatrixArena globalArena;
+
+// Devolve ao SO as páginas inteiras de um buffer; o próximo acesso volta a fazer first touch
+void release_pages(void *ptr, size_t bytes) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = ((uintptr_t)ptr + page - 1) / page * page;
+    uintptr_t end = ((uintptr_t)ptr + bytes) / page * page;
+    if (end > start)
+        madvise((void *)start, end - start, MADV_DONTNEED);
 }
 
-// Algoritmo standard (i-j-k)
-double OnMult(int m_ar, int m_br) {
-    double *matrixA, *matrixB, *matrixC;
-    matrixA = (double *)malloc((m_ar * m_ar) * sizeof(double));
-    matrixB = (double *)malloc((m_ar * m_ar) * sizeof(double));
-    matrixC = (double *)malloc((m_ar * m_ar) * sizeof(double));
-    initialize_matrices(matrixA, matrixB, matrixC, m_ar, m_br);
+// Política NUMA para os kernels paralelos
+// - firstTouch: inicialização paralela com o mesmo schedule(static) do ciclo de cálculo,
+//   para que cada página fique no nó da thread que a vai usar
+// - bind: afinidade das threads (sobrepõe-se a OMP_PLACES/OMP_PROC_BIND se estiverem definidos)
+// - replicateB: uma cópia de B por nó NUMA, lida pelas threads desse nó
+enum ThreadBind { BIND_NONE = 0, BIND_CLOSE = 1, BIND_SPREAD = 2 };
 
-    double start_time = omp_get_wtime();
+struct NumaPolicy {
+    bool firstTouch;
+    int bind;
+    bool replicateB;
+};
+
+NumaPolicy globalNuma = {false, BIND_NONE, false};
+
+string numa_policy_name(const NumaPolicy &policy) {
+    if (!policy.firstTouch && policy.bind == BIND_NONE && !policy.replicateB)
+        return "off";
+    string name = policy.firstTouch ? "firsttouch" : "serialinit";
+    if (policy.bind == BIND_CLOSE) name += "+close";
+    if (policy.bind == BIND_SPREAD) name += "+spread";
+    if (policy.replicateB) name += "+replB";
+    return name;
+}
+
+struct NumaTopology {
+    vector<int> cpus;     // CPUs permitidas ao processo
+    vector<int> cpuNode;  // nó NUMA de cada CPU (indexado pelo id da CPU)
+    vector<int> cpuCore;  // núcleo físico de cada CPU (package e core_id); irmãs SMT partilham o valor
+    int numNodes;
+};
+
+// Lê listas do tipo "0-3,8-11" do sysfs
+vector<int> parse_cpulist(const string &list) {
+    vector<int> cpus;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == string::npos) end = list.size();
+        string range = list.substr(pos, end - pos);
+        size_t dash = range.find('-');
+        if (!range.empty() && isdigit((unsigned char)range[0])) {
+            int lo = stoi(range);
+            int hi = (dash == string::npos) ? lo : stoi(range.substr(dash + 1));
+            for (int c = lo; c <= hi; c++)
+                cpus.push_back(c);
+        }
+        pos = end + 1;
+    }
+    return cpus;
+}
+
+NumaTopology detect_numa_topology() {
+    NumaTopology topo;
+    topo.numNodes = 1;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    sched_getaffinity(0, sizeof(mask), &mask);
+    for (int c = 0; c < CPU_SETSIZE; c++)
+        if (CPU_ISSET(c, &mask))
+            topo.cpus.push_back(c);
+    int maxCpu = topo.cpus.empty() ? 0 : topo.cpus.back();
+    topo.cpuNode.assign(maxCpu + 1, 0);
+    topo.cpuCore.assign(maxCpu + 1, 0);
+    for (int c : topo.cpus) {
+        string base = "/sys/devices/system/cpu/cpu" + to_string(c) + "/topology/";
+        int package = 0, core = c;
+        ifstream pkgIn(base + "physical_package_id"), coreIn(base + "core_id");
+        pkgIn >> package;
+        coreIn >> core;
+        topo.cpuCore[c] = package * 65536 + core;
+    }
+
+    DIR *dir = opendir("/sys/devices/system/node");
+    if (dir == nullptr)
+        return topo;
+    int maxNode = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (strncmp(entry->d_name, "node", 4) != 0 || !isdigit((unsigned char)entry->d_name[4]))
+            continue;
+        int node = atoi(entry->d_name + 4);
+        ifstream in(string("/sys/devices/system/node/") + entry->d_name + "/cpulist");
+        string list;
+        getline(in, list);
+        for (int c : parse_cpulist(list))
+            if (c <= maxCpu)
+                topo.cpuNode[c] = node;
+        maxNode = max(maxNode, node);
+    }
+    closedir(dir);
+    topo.numNodes = maxNode + 1;
+    return topo;
+}
+
+const NumaTopology &numa_topology() {
+    static NumaTopology topo = detect_numa_topology();
+    return topo;
+}
+
+int current_numa_node() {
+    const NumaTopology &topo = numa_topology();
+    int cpu = sched_getcpu();
+    if (cpu < 0 || cpu >= (int)topo.cpuNode.size())
+        return 0;
+    return topo.cpuNode[cpu];
+}
+
+// Lista explícita de CPUs (thread i -> cpus[i]) que se sobrepõe à política; usada pelo estudo de escalabilidade
+vector<int> threadCpuOverride;
+
+// Fixa cada thread OpenMP a uma CPU: close enche um nó antes de passar ao seguinte,
+// spread alterna entre nós. BIND_NONE devolve a máscara original do processo.
+void apply_thread_binding(int bind) {
+    const NumaTopology &topo = numa_topology();
+    if (topo.cpus.empty())
+        return;
+    if (!threadCpuOverride.empty())
+        bind = BIND_CLOSE;
+    vector<int> order = threadCpuOverride;
+    if (order.empty()) {
+        order = topo.cpus;
+        stable_sort(order.begin(), order.end(), [&](int a, int b) { return topo.cpuNode[a] < topo.cpuNode[b]; });
+    }
+    if (bind == BIND_SPREAD && threadCpuOverride.empty()) {
+        vector<vector<int>> perNode(topo.numNodes);
+        for (int c : order)
+            perNode[topo.cpuNode[c]].push_back(c);
+        order.clear();
+        for (size_t idx = 0; order.size() < topo.cpus.size(); idx++)
+            for (auto &cpus : perNode)
+                if (idx < cpus.size())
+                    order.push_back(cpus[idx]);
+    }
+#pragma omp parallel
+    {
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        if (bind == BIND_NONE) {
+            for (int c : topo.cpus)
+                CPU_SET(c, &mask);
+        } else {
+            CPU_SET(order[omp_get_thread_num() % order.size()], &mask);
+        }
+        pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+    }
+}
+
+// Inicialização first-touch: as linhas i de A, B e C são tocadas pela thread que
+// as processa no ciclo paralelo (schedule(static) sobre i)
+void initialize_matrices_parallel(double *matrixA, double *matrixB, double *matrixC, int m_ar, int m_br) {
+#pragma omp parallel for schedule(static)
     for (int i = 0; i < m_ar; i++) {
-        for (int j = 0; j < m_br; j++) {
-            double temp = 0;
-            for (int k = 0; k < m_ar; k++) {
-                temp += matrixA[i * m_ar + k] * matrixB[k * m_br + j];
+        for (int j = 0; j < m_ar; j++)
+            matrixA[i * m_ar + j] = 1.0;
+        for (int j = 0; j < m_br; j++)
+            matrixB[i * m_br + j] = (double)(i + 1);
+        for (int j = 0; j < m_br; j++)
+            matrixC[i * m_br + j] = 0.0;
+    }
+}
+
+// Prepara matrizes e threads de acordo com globalNuma
+void initialize_matrices_numa(double *matrixA, double *matrixB, double *matrixC, int m_ar, int m_br) {
+    apply_thread_binding(globalNuma.bind);
+    if (globalNuma.firstTouch) {
+        // A arena já foi tocada por execuções anteriores: liberta as páginas para que
+        // o first touch volte a decidir em que nó ficam
+        release_pages(matrixA, (size_t)m_ar * m_ar * sizeof(double));
+        release_pages(matrixB, (size_t)m_br * m_br * sizeof(double));
+        release_pages(matrixC, (size_t)m_ar * m_br * sizeof(double));
+        initialize_matrices_parallel(matrixA, matrixB, matrixC, m_ar, m_br);
+    }
+    else
+        initialize_matrices(matrixA, matrixB, matrixC, m_ar, m_br);
+}
+
+// Cria uma réplica de B por nó NUMA; a primeira thread a chegar a cada nó faz a cópia
+// (first touch), por isso só tem efeito com as threads fixadas (bind close/spread).
+// Sem replicação devolve um vetor vazio e os kernels usam a matriz B original.
+vector<double *> replicate_B_per_node(const double *matrixB, int m_br) {
+    vector<double *> replicas;
+    if (!globalNuma.replicateB || numa_topology().numNodes < 2)
+        return replicas;
+    replicas.assign(numa_topology().numNodes, nullptr);
+#pragma omp parallel
+    {
+        int node = current_numa_node();
+        bool owner = false;
+#pragma omp critical
+        {
+            if (replicas[node] == nullptr) {
+                replicas[node] = (double *)malloc((size_t)m_br * m_br * sizeof(double));
+                owner = true;
             }
-            matrixC[i * m_ar + j] = temp;
         }
+        if (owner)
+            memcpy(replicas[node], matrixB, (size_t)m_br * m_br * sizeof(double));
     }
-    double elapsed = omp_get_wtime() - start_time;
+    return replicas;
+}
 
-    cout << "Result matrix (first row): ";
-    for (int j = 0; j < min(10, m_br); j++)
-        cout << matrixC[j] << " ";
-    cout << endl;
+template <typename T>
+const T *local_B(const vector<T *> &replicas, const T *matrixB) {
+    if (replicas.empty())
+        return matrixB;
+    T *replica = replicas[current_numa_node()];
+    return replica != nullptr ? replica : matrixB;
+}
 
-    clean_matrices(matrixA, matrixB, matrixC);
-    return elapsed;
+void free_replicas(vector<double *> &replicas) {
+    for (double *replica : replicas)
+        free(replica);
+    replicas.clear();
+}
+
+// Tipos de elemento
+// Os kernels são templates sobre o tipo guardado em A e B (T) e o tipo de C, onde se acumula (Acc):
+// double/double, float/float e os formatos de 16 bits bf16/fp16 com acumulação em float.
+// bf16 são os 16 bits altos de um float (mesmo expoente, 7 bits de mantissa), com arredondamento ao par.
+struct bf16 {
+    uint16_t bits;
+
+    bf16() = default;
+    bf16(float f) {
+        uint32_t u;
+        memcpy(&u, &f, sizeof(u));
+        if ((u & 0x7fffffff) > 0x7f800000)
+            bits = (uint16_t)((u >> 16) | 0x40);  // NaN continua NaN
+        else
+            bits = (uint16_t)((u + 0x7fff + ((u >> 16) & 1)) >> 16);
+    }
+    operator float() const {
+        uint32_t u = (uint32_t)bits << 16;
+        float f;
+        memcpy(&f, &u, sizeof(f));
+        return f;
+    }
+};
+
+// fp16: IEEE binary16 (5 bits de expoente, 10 de mantissa). Conversões por manipulação de bits (sem F16C),
+// com subnormais tratados por uma multiplicação/soma com constantes mágicas para o ciclo vetorizar.
+struct fp16 {
+    uint16_t bits;
+
+    fp16() = default;
+    fp16(float f) {
+        uint32_t u, sign;
+        memcpy(&u, &f, sizeof(u));
+        sign = u & 0x80000000u;
+        u ^= sign;
+        if (u >= (uint32_t)(127 + 16) << 23) {
+            bits = (u > 0x7f800000u) ? 0x7e00 : 0x7c00;  // NaN ou overflow para infinito
+        } else if (u < (uint32_t)113 << 23) {
+            // Subnormal ou zero: a soma com 0.5 alinha a mantissa e arredonda ao par
+            float magic = 0.5f, x;
+            uint32_t m;
+            memcpy(&x, &u, sizeof(x));
+            x += magic;
+            memcpy(&m, &x, sizeof(m));
+            bits = (uint16_t)(m - 0x3f000000u);
+        } else {
+            uint32_t odd = (u >> 13) & 1;
+            u += ((uint32_t)(15 - 127) << 23) + 0xfff + odd;
+            bits = (uint16_t)(u >> 13);
+        }
+        bits |= (uint16_t)(sign >> 16);
+    }
+    operator float() const {
+        uint32_t u = (uint32_t)(bits & 0x7fff) << 13;
+        float f;
+        memcpy(&f, &u, sizeof(f));
+        f *= 5.192296858534828e33f;  // 2^112 reajusta o expoente (também para subnormais)
+        memcpy(&u, &f, sizeof(u));
+        if (f >= 65536.0f)
+            u |= 0x7f800000u;  // infinito / NaN
+        u |= (uint32_t)(bits & 0x8000) << 16;
+        memcpy(&f, &u, sizeof(f));
+        return f;
+    }
+};
+
+template <typename T> struct ElemTraits;
+template <> struct ElemTraits<double> {
+    typedef double acc;
+    static const char *name() { return "double"; }
+    static double unit_roundoff() { return ldexp(1.0, -53); }
+};
+template <> struct ElemTraits<float> {
+    typedef float acc;
+    static const char *name() { return "float"; }
+    static double unit_roundoff() { return ldexp(1.0, -24); }
+};
+template <> struct ElemTraits<bf16> {
+    typedef float acc;
+    static const char *name() { return "bf16"; }
+    static double unit_roundoff() { return ldexp(1.0, -8); }
+};
+template <> struct ElemTraits<fp16> {
+    typedef float acc;
+    static const char *name() { return "fp16"; }
+    static double unit_roundoff() { return ldexp(1.0, -11); }
+};
+
+// Kernels: C += alpha * A * B, com A M x K, B K x N e C M x N em row-major com leading dimensions.
+// Transposições e beta são tratados pela função gemm antes de chamar o kernel.
+
+// Algoritmo standard (i-j-k)
+template <typename T, typename Acc>
+void gemm_standard(int M, int N, int K, double alpha, const T *A, int lda, const T *B, int ldb, Acc *C, int ldc) {
+    for (int i = 0; i < M; i++) {
+        for (int j = 0; j < N; j++) {
+            Acc temp = 0;
+            for (int k = 0; k < K; k++) {
+                temp += (Acc)A[(size_t)i * lda + k] * (Acc)B[(size_t)k * ldb + j];
+            }
+            C[(size_t)i * ldc + j] += (Acc)alpha * temp;
+        }
+    }
+}
+
+// Multiplicação por linha
+template <typename T, typename Acc>
+void gemm_line(int M, int N, int K, double alpha, const T *A, int lda, const T *B, int ldb, Acc *C, int ldc) {
+    for (int i = 0; i < M; i++) {
+        for (int k = 0; k < K; k++) {
+            Acc temp = (Acc)alpha * (Acc)A[(size_t)i * lda + k];
+            for (int j = 0; j < N; j++) {
+                C[(size_t)i * ldc + j] += temp * (Acc)B[(size_t)k * ldb + j];
+            }
+        }
+    }
+}
+
+// Multiplicação por linha paralela externa
+// O schedule do ciclo é o de omp_set_schedule (static por omissão, como antes; o autotuner pode escolher outro)
+template <typename T, typename Acc>
+void gemm_line_ext_parallel(int M, int N, int K, double alpha, const T *A, int lda, const T *B, int ldb, Acc *C, int ldc,
+                            const vector<T *> &replicas, omp_sched_t schedule = omp_sched_static, int chunk = 0) {
+    omp_set_schedule(schedule, chunk);
+#pragma omp parallel
+    {
+        const T *Bl = local_B(replicas, B);
+#pragma omp for schedule(runtime)
+        for (int i = 0; i < M; i++) {
+            for (int k = 0; k < K; k++) {
+                Acc temp = (Acc)alpha * (Acc)A[(size_t)i * lda + k];
+                for (int j = 0; j < N; j++) {
+                    C[(size_t)i * ldc + j] += temp * (Acc)Bl[(size_t)k * ldb + j];
+                }
+            }
+        }
+    }
+}
+
+// Multiplicação por linha paralela interna
+template <typename T, typename Acc>
+void gemm_line_int_parallel(int M, int N, int K, double alpha, const T *A, int lda, const T *B, int ldb, Acc *C, int ldc,
+                            omp_sched_t schedule = omp_sched_static, int chunk = 0) {
+    omp_set_schedule(schedule, chunk);
+#pragma omp parallel
+    {
+        for (int i = 0; i < M; i++) {
+            for (int k = 0; k < K; k++) {
+                Acc temp = (Acc)alpha * (Acc)A[(size_t)i * lda + k];
+#pragma omp for schedule(runtime)
+                for (int j = 0; j < N; j++) {
+                    C[(size_t)i * ldc + j] += temp * (Acc)B[(size_t)k * ldb + j];
+                }
+            }
+        }
+    }
+}
+
+// Multiplicação em bloco: blocos bm x bk de A e bk x bn de B (quadrados com bm = bk = bn)
+template <typename T, typename Acc>
+void gemm_block(int M, int N, int K, double alpha, const T *A, int lda, const T *B, int ldb, Acc *C, int ldc, int bm, int bk, int bn) {
+    for (int iBlock = 0; iBlock < M; iBlock += bm) {
+        for (int kBlock = 0; kBlock < K; kBlock += bk) {
+            for (int jBlock = 0; jBlock < N; jBlock += bn) {
+                int iMax = min(iBlock + bm, M);
+                int kMax = min(kBlock + bk, K);
+                int jMax = min(jBlock + bn, N);
+                for (int i = iBlock; i < iMax; i++) {
+                    for (int k = kBlock; k < kMax; k++) {
+                        Acc temp = (Acc)alpha * (Acc)A[(size_t)i * lda + k];
+                        for (int j = jBlock; j < jMax; j++) {
+                            C[(size_t)i * ldc + j] += temp * (Acc)B[(size_t)k * ldb + j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Multiplicação em bloco paralela: C é dividido em tiles 2D (bm x bn) e cada tile é uma task OpenMP
+// que percorre todos os blocos de k, por isso não há escritas concorrentes no mesmo tile.
+template <typename T, typename Acc>
+void gemm_block_parallel(int M, int N, int K, double alpha, const T *A, int lda, const T *B, int ldb, Acc *C, int ldc,
+                         int bm, int bk, int bn, const vector<T *> &replicas) {
+    // Com poucos tiles por thread o balanceamento piora; reduz o tile de C (não o bloco de k)
+    int threads = omp_get_max_threads();
+    while (max(bm, bn) > 32 && (long long)((M + bm - 1) / bm) * ((N + bn - 1) / bn) < 4LL * threads) {
+        bm = max(bm / 2, 1);
+        bn = max(bn / 2, 1);
+    }
+
+#pragma omp parallel
+#pragma omp single
+    {
+        for (int iBlock = 0; iBlock < M; iBlock += bm) {
+            for (int jBlock = 0; jBlock < N; jBlock += bn) {
+#pragma omp task firstprivate(iBlock, jBlock)
+                {
+                    const T *Bl = local_B(replicas, B);
+                    int iMax = min(iBlock + bm, M);
+                    int jMax = min(jBlock + bn, N);
+                    for (int kBlock = 0; kBlock < K; kBlock += bk) {
+                        int kMax = min(kBlock + bk, K);
+                        for (int i = iBlock; i < iMax; i++) {
+                            for (int k = kBlock; k < kMax; k++) {
+                                Acc temp = (Acc)alpha * (Acc)A[(size_t)i * lda + k];
+                                for (int j = jBlock; j < jMax; j++) {
+                                    C[(size_t)i * ldc + j] += temp * (Acc)Bl[(size_t)k * ldb + j];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Motor GEMM com micro-kernel em registos (estilo GotoBLAS)
+// B é empacotado em painéis kc x NR e A em painéis MR x kc, contíguos e alinhados a 64 bytes,
+// e o micro-kernel mantém um bloco MR x NR de C em registos durante todo o ciclo k.
+// O ISA (AVX-512, AVX2+FMA ou escalar) é escolhido em runtime.
+
+struct MicroKernel {
+    const char *isa;
+    int mr, nr;
+    void (*run)(int kc, const double *Ap, const double *Bp, double *C, int ldc);
+};
+
+static void micro_kernel_scalar(int kc, const double *Ap, const double *Bp, double *C, int ldc) {
+    double acc[4][4] = {{0}};
+    for (int p = 0; p < kc; p++) {
+        for (int r = 0; r < 4; r++) {
+            double a = Ap[p * 4 + r];
+            for (int c = 0; c < 4; c++)
+                acc[r][c] += a * Bp[p * 4 + c];
+        }
+    }
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 4; c++)
+            C[r * ldc + c] += acc[r][c];
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// 6x8: 12 acumuladores ymm, 2 loads de B e 6 broadcasts de A por iteração
+__attribute__((target("avx2,fma")))
+static void micro_kernel_avx2(int kc, const double *Ap, const double *Bp, double *C, int ldc) {
+    __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+    __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+    __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+    __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+    __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+    __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+    for (int p = 0; p < kc; p++) {
+        __m256d b0 = _mm256_load_pd(Bp);
+        __m256d b1 = _mm256_load_pd(Bp + 4);
+        __m256d a;
+        a = _mm256_broadcast_sd(Ap + 0); c00 = _mm256_fmadd_pd(a, b0, c00); c01 = _mm256_fmadd_pd(a, b1, c01);
+        a = _mm256_broadcast_sd(Ap + 1); c10 = _mm256_fmadd_pd(a, b0, c10); c11 = _mm256_fmadd_pd(a, b1, c11);
+        a = _mm256_broadcast_sd(Ap + 2); c20 = _mm256_fmadd_pd(a, b0, c20); c21 = _mm256_fmadd_pd(a, b1, c21);
+        a = _mm256_broadcast_sd(Ap + 3); c30 = _mm256_fmadd_pd(a, b0, c30); c31 = _mm256_fmadd_pd(a, b1, c31);
+        a = _mm256_broadcast_sd(Ap + 4); c40 = _mm256_fmadd_pd(a, b0, c40); c41 = _mm256_fmadd_pd(a, b1, c41);
+        a = _mm256_broadcast_sd(Ap + 5); c50 = _mm256_fmadd_pd(a, b0, c50); c51 = _mm256_fmadd_pd(a, b1, c51);
+        Ap += 6;
+        Bp += 8;
+    }
+    double *c;
+    c = C + 0 * ldc; _mm256_storeu_pd(c, _mm256_add_pd(_mm256_loadu_pd(c), c00)); _mm256_storeu_pd(c + 4, _mm256_add_pd(_mm256_loadu_pd(c + 4), c01));
+    c = C + 1 * ldc; _mm256_storeu_pd(c, _mm256_add_pd(_mm256_loadu_pd(c), c10)); _mm256_storeu_pd(c + 4, _mm256_add_pd(_mm256_loadu_pd(c + 4), c11));
+    c = C + 2 * ldc; _mm256_storeu_pd(c, _mm256_add_pd(_mm256_loadu_pd(c), c20)); _mm256_storeu_pd(c + 4, _mm256_add_pd(_mm256_loadu_pd(c + 4), c21));
+    c = C + 3 * ldc; _mm256_storeu_pd(c, _mm256_add_pd(_mm256_loadu_pd(c), c30)); _mm256_storeu_pd(c + 4, _mm256_add_pd(_mm256_loadu_pd(c + 4), c31));
+    c = C + 4 * ldc; _mm256_storeu_pd(c, _mm256_add_pd(_mm256_loadu_pd(c), c40)); _mm256_storeu_pd(c + 4, _mm256_add_pd(_mm256_loadu_pd(c + 4), c41));
+    c = C + 5 * ldc; _mm256_storeu_pd(c, _mm256_add_pd(_mm256_loadu_pd(c), c50)); _mm256_storeu_pd(c + 4, _mm256_add_pd(_mm256_loadu_pd(c + 4), c51));
+}
+
+// 6x16: 12 acumuladores zmm
+__attribute__((target("avx512f")))
+static void micro_kernel_avx512(int kc, const double *Ap, const double *Bp, double *C, int ldc) {
+    __m512d c00 = _mm512_setzero_pd(), c01 = _mm512_setzero_pd();
+    __m512d c10 = _mm512_setzero_pd(), c11 = _mm512_setzero_pd();
+    __m512d c20 = _mm512_setzero_pd(), c21 = _mm512_setzero_pd();
+    __m512d c30 = _mm512_setzero_pd(), c31 = _mm512_setzero_pd();
+    __m512d c40 = _mm512_setzero_pd(), c41 = _mm512_setzero_pd();
+    __m512d c50 = _mm512_setzero_pd(), c51 = _mm512_setzero_pd();
+    for (int p = 0; p < kc; p++) {
+        __m512d b0 = _mm512_load_pd(Bp);
+        __m512d b1 = _mm512_load_pd(Bp + 8);
+        __m512d a;
+        a = _mm512_set1_pd(Ap[0]); c00 = _mm512_fmadd_pd(a, b0, c00); c01 = _mm512_fmadd_pd(a, b1, c01);
+        a = _mm512_set1_pd(Ap[1]); c10 = _mm512_fmadd_pd(a, b0, c10); c11 = _mm512_fmadd_pd(a, b1, c11);
+        a = _mm512_set1_pd(Ap[2]); c20 = _mm512_fmadd_pd(a, b0, c20); c21 = _mm512_fmadd_pd(a, b1, c21);
+        a = _mm512_set1_pd(Ap[3]); c30 = _mm512_fmadd_pd(a, b0, c30); c31 = _mm512_fmadd_pd(a, b1, c31);
+        a = _mm512_set1_pd(Ap[4]); c40 = _mm512_fmadd_pd(a, b0, c40); c41 = _mm512_fmadd_pd(a, b1, c41);
+        a = _mm512_set1_pd(Ap[5]); c50 = _mm512_fmadd_pd(a, b0, c50); c51 = _mm512_fmadd_pd(a, b1, c51);
+        Ap += 6;
+        Bp += 16;
+    }
+    double *c;
+    c = C + 0 * ldc; _mm512_storeu_pd(c, _mm512_add_pd(_mm512_loadu_pd(c), c00)); _mm512_storeu_pd(c + 8, _mm512_add_pd(_mm512_loadu_pd(c + 8), c01));
+    c = C + 1 * ldc; _mm512_storeu_pd(c, _mm512_add_pd(_mm512_loadu_pd(c), c10)); _mm512_storeu_pd(c + 8, _mm512_add_pd(_mm512_loadu_pd(c + 8), c11));
+    c = C + 2 * ldc; _mm512_storeu_pd(c, _mm512_add_pd(_mm512_loadu_pd(c), c20)); _mm512_storeu_pd(c + 8, _mm512_add_pd(_mm512_loadu_pd(c + 8), c21));
+    c = C + 3 * ldc; _mm512_storeu_pd(c, _mm512_add_pd(_mm512_loadu_pd(c), c30)); _mm512_storeu_pd(c + 8, _mm512_add_pd(_mm512_loadu_pd(c + 8), c31));
+    c = C + 4 * ldc; _mm512_storeu_pd(c, _mm512_add_pd(_mm512_loadu_pd(c), c40)); _mm512_storeu_pd(c + 8, _mm512_add_pd(_mm512_loadu_pd(c + 8), c41));
+    c = C + 5 * ldc; _mm512_storeu_pd(c, _mm512_add_pd(_mm512_loadu_pd(c), c50)); _mm512_storeu_pd(c + 8, _mm512_add_pd(_mm512_loadu_pd(c + 8), c51));
+}
+#endif
+
+MicroKernel select_micro_kernel() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return {"AVX-512", 6, 16, micro_kernel_avx512};
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return {"AVX2", 6, 8, micro_kernel_avx2};
+#endif
+    return {"Scalar", 4, 4, micro_kernel_scalar};
+}
+
+template <typename T = double>
+T *alloc_aligned(size_t count) {
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, 64, count * sizeof(T)) != 0) {
+        cerr << "Error allocating aligned buffer" << endl;
+        exit(1);
+    }
+    return (T *)ptr;
+}
+
+// Empacota alpha * A[ic:ic+mc, pc:pc+kc] em micro-painéis de mr linhas (preenchidos com zeros nas bordas)
+void pack_A(int mc, int kc, const double *A, int lda, int mr, double alpha, double *Ap) {
+    for (int ir = 0; ir < mc; ir += mr) {
+        int rows = min(mr, mc - ir);
+        for (int p = 0; p < kc; p++) {
+            for (int r = 0; r < rows; r++)
+                Ap[p * mr + r] = alpha * A[(size_t)(ir + r) * lda + p];
+            for (int r = rows; r < mr; r++)
+                Ap[p * mr + r] = 0.0;
+        }
+        Ap += mr * kc;
+    }
+}
+
+// Empacota B[pc:pc+kc, jc:jc+nc] em micro-painéis de nr colunas
+void pack_B(int kc, int nc, const double *B, int ldb, int nr, double *Bp) {
+    for (int jr = 0; jr < nc; jr += nr) {
+        int cols = min(nr, nc - jr);
+        for (int p = 0; p < kc; p++) {
+            const double *b = B + (size_t)p * ldb + jr;
+            for (int c = 0; c < cols; c++)
+                Bp[p * nr + c] = b[c];
+            for (int c = cols; c < nr; c++)
+                Bp[p * nr + c] = 0.0;
+        }
+        Bp += nr * kc;
+    }
+}
+
+// C += alpha * A * B, com painéis MC x KC de A e KC x NC de B
+void gemm_simd(int M, int N, int K, double alpha, const double *A, int lda, const double *B, int ldb, double *C, int ldc,
+               const MicroKernel &uk, int MC, int KC, int NC) {
+    int mr = uk.mr, nr = uk.nr;
+    // MC e NC arredondados para múltiplos do micro-kernel para não gerar blocos de borda a meio
+    MC = max(mr, MC / mr * mr);
+    NC = max(nr, NC / nr * nr);
+    KC = max(1, KC);
+    double *Ap = alloc_aligned((size_t)MC * KC);
+    double *Bp = alloc_aligned((size_t)NC * KC);
+    double edge[16 * 16];
+
+    for (int jc = 0; jc < N; jc += NC) {
+        int nc = min(NC, N - jc);
+        for (int pc = 0; pc < K; pc += KC) {
+            int kc = min(KC, K - pc);
+            pack_B(kc, nc, B + (size_t)pc * ldb + jc, ldb, nr, Bp);
+            for (int ic = 0; ic < M; ic += MC) {
+                int mc = min(MC, M - ic);
+                pack_A(mc, kc, A + (size_t)ic * lda + pc, lda, mr, alpha, Ap);
+                for (int jr = 0; jr < nc; jr += nr) {
+                    int cols = min(nr, nc - jr);
+                    for (int ir = 0; ir < mc; ir += mr) {
+                        int rows = min(mr, mc - ir);
+                        double *c = C + (size_t)(ic + ir) * ldc + jc + jr;
+                        const double *a = Ap + ir * kc;
+                        const double *b = Bp + jr * kc;
+                        if (rows == mr && cols == nr) {
+                            uk.run(kc, a, b, c, ldc);
+                        } else {
+                            // Bloco de borda: calcula num buffer temporário e soma só a parte válida
+                            fill(edge, edge + mr * nr, 0.0);
+                            uk.run(kc, a, b, edge, nr);
+                            for (int r = 0; r < rows; r++)
+                                for (int col = 0; col < cols; col++)
+                                    c[(size_t)r * ldc + col] += edge[r * nr + col];
+                        }
+                    }
+                }
+            }
+        }
+    }
+    free(Ap);
+    free(Bp);
+}
+
+// Strassen recursivo com crossover para o kernel em bloco
+// Cada nível divide as matrizes em quadrantes (0 = 11, 1 = 12, 2 = 21, 3 = 22) e calcula 7 produtos:
+//   M1 = (A11 + A22)(B11 + B22)   M2 = (A21 + A22) B11         M3 = A11 (B12 - B22)
+//   M4 = A22 (B21 - B11)          M5 = (A11 + A12) B22         M6 = (A21 - A11)(B11 + B12)
+//   M7 = (A12 - A22)(B21 + B22)
+// Nos primeiros strassenTaskDepth níveis os 7 produtos correm como tasks OpenMP, cada um com os seus
+// temporários; abaixo disso a recursão é sequencial e reutiliza 3 temporários por nível.
+// Todos os temporários saem de um workspace único reservado antes da medição.
+
+int strassenCrossover = 512;
+int strassenTaskDepth = 1;
+
+struct StrassenProduct {
+    int a1, a2;
+    double aSign;  // a2 < 0: operando A é só o quadrante a1
+    int b1, b2;
+    double bSign;
+};
+
+static const StrassenProduct STRASSEN_PRODUCTS[7] = {
+    {0, 3, 1.0, 0, 3, 1.0},
+    {2, 3, 1.0, 0, -1, 0.0},
+    {0, -1, 0.0, 1, 3, -1.0},
+    {3, -1, 0.0, 2, 0, -1.0},
+    {0, 1, 1.0, 3, -1, 0.0},
+    {2, 0, -1.0, 0, 1, 1.0},
+    {1, 3, -1.0, 2, 3, 1.0},
+};
+
+// Coeficiente de cada Mi em C11, C12, C21, C22
+static const double STRASSEN_COMBINE[4][7] = {
+    {1, 0, 0, 1, -1, 0, 1},
+    {0, 0, 1, 0, 1, 0, 0},
+    {0, 1, 0, 1, 0, 0, 0},
+    {1, -1, 1, 0, 0, 1, 0},
+};
+
+struct Workspace {
+    double *ptr;
+    size_t left;
+
+    double *take(size_t count) {
+        if (count > left) {
+            cerr << "Strassen workspace exhausted" << endl;
+            exit(1);
+        }
+        double *out = ptr;
+        ptr += count;
+        left -= count;
+        return out;
+    }
+};
+
+size_t strassen_workspace_seq(int n, int leaf) {
+    if (n <= leaf)
+        return 0;
+    size_t h = n / 2;
+    return 3 * h * h + strassen_workspace_seq(n / 2, leaf);
+}
+
+size_t strassen_workspace(int n, int leaf, int taskDepth) {
+    if (n <= leaf || taskDepth == 0)
+        return strassen_workspace_seq(n, leaf);
+    size_t h = n / 2;
+    return 7 * (3 * h * h + strassen_workspace(n / 2, leaf, taskDepth - 1));
+}
+
+// C = A * B (n x n, com leading dimensions), em bloco; o taskloop reparte os blocos de linhas
+// pelas threads livres quando é chamado dentro da região paralela do Strassen
+void block_multiply_strided(int n, const double *A, int lda, const double *B, int ldb, double *C, int ldc, int bkSize) {
+#pragma omp taskloop
+    for (int iBlock = 0; iBlock < n; iBlock += bkSize) {
+        int iMax = min(iBlock + bkSize, n);
+        for (int i = iBlock; i < iMax; i++)
+            fill(C + (size_t)i * ldc, C + (size_t)i * ldc + n, 0.0);
+        for (int kBlock = 0; kBlock < n; kBlock += bkSize) {
+            for (int jBlock = 0; jBlock < n; jBlock += bkSize) {
+                int kMax = min(kBlock + bkSize, n);
+                int jMax = min(jBlock + bkSize, n);
+                for (int i = iBlock; i < iMax; i++) {
+                    for (int k = kBlock; k < kMax; k++) {
+                        double temp = A[(size_t)i * lda + k];
+                        for (int j = jBlock; j < jMax; j++) {
+                            C[(size_t)i * ldc + j] += temp * B[(size_t)k * ldb + j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// T = X1 + sign * X2 (h x h)
+void strassen_add(int h, const double *X1, const double *X2, int ldx, double sign, double *T) {
+    for (int i = 0; i < h; i++)
+        for (int j = 0; j < h; j++)
+            T[(size_t)i * h + j] = X1[(size_t)i * ldx + j] + sign * X2[(size_t)i * ldx + j];
+}
+
+void strassen_recursive(int n, const double *A, int lda, const double *B, int ldb, double *C, int ldc,
+                        int leaf, int taskDepth, int bkSize, Workspace &ws);
+
+// Calcula o produto p para a metade h e escreve-o em M (h x h)
+void strassen_product(int p, int h, const double *A, int lda, const double *B, int ldb, double *M,
+                      int leaf, int taskDepth, int bkSize, Workspace &ws) {
+    const StrassenProduct &sp = STRASSEN_PRODUCTS[p];
+    auto quadA = [&](int q) { return A + (size_t)(q / 2) * h * lda + (q % 2) * h; };
+    auto quadB = [&](int q) { return B + (size_t)(q / 2) * h * ldb + (q % 2) * h; };
+    double *T1 = ws.take((size_t)h * h);
+    double *T2 = ws.take((size_t)h * h);
+    const double *opA = quadA(sp.a1);
+    const double *opB = quadB(sp.b1);
+    int ldA = lda, ldB = ldb;
+    if (sp.a2 >= 0) {
+        strassen_add(h, quadA(sp.a1), quadA(sp.a2), lda, sp.aSign, T1);
+        opA = T1;
+        ldA = h;
+    }
+    if (sp.b2 >= 0) {
+        strassen_add(h, quadB(sp.b1), quadB(sp.b2), ldb, sp.bSign, T2);
+        opB = T2;
+        ldB = h;
+    }
+    strassen_recursive(h, opA, ldA, opB, ldB, M, h, leaf, taskDepth, bkSize, ws);
+}
+
+void strassen_recursive(int n, const double *A, int lda, const double *B, int ldb, double *C, int ldc,
+                        int leaf, int taskDepth, int bkSize, Workspace &ws) {
+    if (n <= leaf) {
+        block_multiply_strided(n, A, lda, B, ldb, C, ldc, bkSize);
+        return;
+    }
+    int h = n / 2;
+    auto quadC = [&](int q) { return C + (size_t)(q / 2) * h * ldc + (q % 2) * h; };
+
+    if (taskDepth > 0) {
+        // Cada task recebe a sua fatia do workspace: T1, T2 e a subárvore ficam na fatia, Mi fica à parte
+        size_t slice = 2 * (size_t)h * h + strassen_workspace(h, leaf, taskDepth - 1);
+        double *M[7];
+        Workspace sub[7];
+        for (int p = 0; p < 7; p++)
+            M[p] = ws.take((size_t)h * h);
+        for (int p = 0; p < 7; p++)
+            sub[p] = {ws.take(slice), slice};
+        for (int p = 0; p < 7; p++) {
+#pragma omp task firstprivate(p) shared(M, sub)
+            strassen_product(p, h, A, lda, B, ldb, M[p], leaf, taskDepth - 1, bkSize, sub[p]);
+        }
+#pragma omp taskwait
+        for (int q = 0; q < 4; q++) {
+#pragma omp task firstprivate(q) shared(M)
+            {
+                double *Cq = quadC(q);
+                for (int i = 0; i < h; i++) {
+                    for (int j = 0; j < h; j++) {
+                        double sum = 0.0;
+                        for (int p = 0; p < 7; p++)
+                            sum += STRASSEN_COMBINE[q][p] * M[p][(size_t)i * h + j];
+                        Cq[(size_t)i * ldc + j] = sum;
+                    }
+                }
+            }
+        }
+#pragma omp taskwait
+        return;
+    }
+
+    // Sequencial: um só Mi de cada vez, acumulado logo nos quadrantes de C
+    Workspace level = ws;
+    double *M = level.take((size_t)h * h);
+    bool written[4] = {false, false, false, false};
+    for (int p = 0; p < 7; p++) {
+        Workspace scratch = level;
+        strassen_product(p, h, A, lda, B, ldb, M, leaf, 0, bkSize, scratch);
+        for (int q = 0; q < 4; q++) {
+            double coef = STRASSEN_COMBINE[q][p];
+            if (coef == 0.0)
+                continue;
+            double *Cq = quadC(q);
+            for (int i = 0; i < h; i++) {
+                double *row = Cq + (size_t)i * ldc;
+                const double *m = M + (size_t)i * h;
+                if (written[q]) {
+                    for (int j = 0; j < h; j++)
+                        row[j] += coef * m[j];
+                } else {
+                    for (int j = 0; j < h; j++)
+                        row[j] = coef * m[j];
+                }
+            }
+            written[q] = true;
+        }
+    }
+}
+
+// Número de níveis e dimensão das folhas para n: a matriz é completada com zeros até leaf * 2^levels.
+// Crossover < 1 conta como 1 e os níveis param em 30 para 1 << levels não transbordar
+void strassen_plan(int n, int crossover, int &levels, int &leaf) {
+    crossover = max(crossover, 1);
+    levels = 0;
+    leaf = n;
+    while (leaf > crossover && levels < 30) {
+        levels++;
+        leaf = (n + (1 << levels) - 1) >> levels;
+    }
+}
+
+// C = alpha * A * B + beta * C com Strassen. Formas retangulares ou que não caibam em leaf * 2^levels
+// são completadas com zeros até um quadrado de lado P; os operandos já com essa forma são usados diretamente.
+void strassen_gemm(int M, int N, int K, double alpha, const double *A, int lda, const double *B, int ldb,
+                   double beta, double *C, int ldc, int crossover, int bkSize, int taskDepth) {
+    int n = max(M, max(N, K));
+    int levels, leaf;
+    strassen_plan(n, crossover, levels, leaf);
+    int P = leaf << levels;
+    int depth = (omp_get_max_threads() > 1) ? min(taskDepth, levels) : 0;
+
+    bool directA = (M == P && K == P);
+    bool directB = (K == P && N == P);
+    bool directC = (M == P && N == P && alpha == 1.0 && beta == 0.0);
+    size_t P2 = (size_t)P * P;
+    size_t wsElems = strassen_workspace(P, leaf, depth) + (directA ? 0 : P2) + (directB ? 0 : P2) + (directC ? 0 : P2);
+    double *wsBase = alloc_aligned(max(wsElems, (size_t)1));
+    Workspace ws = {wsBase, wsElems};
+
+    const double *Ap = A, *Bp = B;
+    double *Cp = C;
+    int ldap = lda, ldbp = ldb, ldcp = ldc;
+    if (!directA) {
+        double *Apad = ws.take(P2);
+        fill(Apad, Apad + P2, 0.0);
+        for (int i = 0; i < M; i++)
+            copy(A + (size_t)i * lda, A + (size_t)i * lda + K, Apad + (size_t)i * P);
+        Ap = Apad;
+        ldap = P;
+    }
+    if (!directB) {
+        double *Bpad = ws.take(P2);
+        fill(Bpad, Bpad + P2, 0.0);
+        for (int k = 0; k < K; k++)
+            copy(B + (size_t)k * ldb, B + (size_t)k * ldb + N, Bpad + (size_t)k * P);
+        Bp = Bpad;
+        ldbp = P;
+    }
+    if (!directC) {
+        Cp = ws.take(P2);
+        ldcp = P;
+    }
+#pragma omp parallel
+#pragma omp single
+    strassen_recursive(P, Ap, ldap, Bp, ldbp, Cp, ldcp, leaf, depth, bkSize, ws);
+
+    if (!directC) {
+        for (int i = 0; i < M; i++) {
+            double *c = C + (size_t)i * ldc;
+            const double *cp = Cp + (size_t)i * P;
+            for (int j = 0; j < N; j++)
+                c[j] = alpha * cp[j] + (beta == 0.0 ? 0.0 : beta * c[j]);
+        }
+    }
+    free(wsBase);
 }
 
-// Multiplicação por linha
-double OnMultLine(int m_ar, int m_br) {
-    double *matrixA, *matrixB, *matrixC;
-    matrixA = (double *)malloc((m_ar * m_ar) * sizeof(double));
-    matrixB = (double *)malloc((m_ar * m_ar) * sizeof(double));
-    matrixC = (double *)malloc((m_ar * m_ar) * sizeof(double));
-    initialize_matrices(matrixA, matrixB, matrixC, m_ar, m_br);
+// Plano do Strassen para um produto n x n (C = A * B, operandos já com lado P usados diretamente), para os
+// chamadores que o querem mostrar; strassen_gemm não escreve nada porque corre dentro das medições
+void print_strassen_plan(int n, int crossover) {
+    int levels, leaf;
+    strassen_plan(n, crossover, levels, leaf);
+    int P = leaf << levels;
+    int depth = (omp_get_max_threads() > 1) ? min(strassenTaskDepth, levels) : 0;
+    size_t wsElems = strassen_workspace(P, leaf, depth) + (P == n ? 0 : 3 * (size_t)P * P);
+    cout << "Strassen: " << levels << " level(s), leaf " << leaf << ", padded to " << P
+         << ", task depth " << depth << ", workspace " << (wsElems * sizeof(double)) / (1024 * 1024) << " MB" << endl;
+}
+
+// Multiplicação cache-oblivious em ordem de Morton (Z-order)
+// As matrizes são guardadas como uma grelha 2^levels x 2^levels de tiles leaf x leaf (row-major dentro da
+// tile) pela ordem Z: os quadrantes (0 = 11, 1 = 12, 2 = 21, 3 = 22) de qualquer submatriz ocupam quatro
+// troços contíguos. A recursão divide C, A e B ao meio até à tile, por isso há sempre um nível em que os
+// operandos cabem em L1, outro em L2 e outro em L3, sem afinar o bloco para uma cache em particular.
+// leaf (em ]MORTON_LEAF/2, MORTON_LEAF], via strassen_plan) só fixa o caso base, pensado para L1.
+// Nos primeiros mortonTaskDepth níveis os 4 produtos de cada fase correm como tasks OpenMP.
+
+const int MORTON_LEAF = 64;
+int mortonTaskDepth = 2;
+
+// Posição da tile (ti, tj) na ordem Z: intercala os bits, com o bit de ti mais significativo em cada par
+size_t morton_tile_index(unsigned ti, unsigned tj) {
+    size_t z = 0;
+    for (int b = 0; b < 16; b++)
+        z |= ((size_t)((ti >> b) & 1) << (2 * b + 1)) | ((size_t)((tj >> b) & 1) << (2 * b));
+    return z;
+}
+
+// Copia X (rows x cols, row-major) para Z (tiles leaf x leaf em ordem de Morton), com zeros fora de X
+void morton_pack(int rows, int cols, const double *X, int ldx, int leaf, int levels, double *Z) {
+    int tiles = 1 << levels;
+#pragma omp parallel for collapse(2)
+    for (int ti = 0; ti < tiles; ti++) {
+        for (int tj = 0; tj < tiles; tj++) {
+            double *tile = Z + morton_tile_index(ti, tj) * leaf * leaf;
+            for (int i = 0; i < leaf; i++) {
+                int r = ti * leaf + i;
+                for (int j = 0; j < leaf; j++) {
+                    int c = tj * leaf + j;
+                    tile[(size_t)i * leaf + j] = (r < rows && c < cols) ? X[(size_t)r * ldx + c] : 0.0;
+                }
+            }
+        }
+    }
+}
+
+// C = alpha * Z + beta * C na parte rows x cols de Z
+void morton_unpack(int rows, int cols, const double *Z, int leaf, int levels, double alpha, double beta, double *C, int ldc) {
+    int tiles = 1 << levels;
+#pragma omp parallel for collapse(2)
+    for (int ti = 0; ti < tiles; ti++) {
+        for (int tj = 0; tj < tiles; tj++) {
+            const double *tile = Z + morton_tile_index(ti, tj) * leaf * leaf;
+            for (int i = 0; i < leaf && ti * leaf + i < rows; i++) {
+                double *c = C + (size_t)(ti * leaf + i) * ldc + tj * leaf;
+                for (int j = 0; j < leaf && tj * leaf + j < cols; j++)
+                    c[j] = alpha * tile[(size_t)i * leaf + j] + (beta == 0.0 ? 0.0 : beta * c[j]);
+            }
+        }
+    }
+}
+
+// C += A * B numa tile leaf x leaf contígua, pela ordem i-k-j da versão por linha; quatro linhas de C
+// de cada vez para cada elemento de B lido servir quatro FMAs
+void morton_leaf(int leaf, const double *A, const double *B, double *C) {
+    int i = 0;
+    for (; i + 4 <= leaf; i += 4) {
+        double *c0 = C + (size_t)i * leaf, *c1 = c0 + leaf, *c2 = c1 + leaf, *c3 = c2 + leaf;
+        const double *a = A + (size_t)i * leaf;
+        for (int k = 0; k < leaf; k++) {
+            double a0 = a[k], a1 = a[leaf + k], a2 = a[2 * leaf + k], a3 = a[3 * leaf + k];
+            const double *b = B + (size_t)k * leaf;
+            for (int j = 0; j < leaf; j++) {
+                c0[j] += a0 * b[j];
+                c1[j] += a1 * b[j];
+                c2[j] += a2 * b[j];
+                c3[j] += a3 * b[j];
+            }
+        }
+    }
+    for (; i < leaf; i++) {
+        double *c = C + (size_t)i * leaf;
+        for (int k = 0; k < leaf; k++) {
+            double a = A[(size_t)i * leaf + k];
+            const double *b = B + (size_t)k * leaf;
+            for (int j = 0; j < leaf; j++)
+                c[j] += a * b[j];
+        }
+    }
+}
+
+// C += A * B para submatrizes n x n em ordem de Morton, em duas fases de 4 produtos que escrevem
+// quadrantes diferentes de C: C_ij += A_i1 B_1j e depois C_ij += A_i2 B_2j
+void morton_recursive(int n, const double *A, const double *B, double *C, int leaf, int taskDepth) {
+    if (n <= leaf) {
+        morton_leaf(leaf, A, B, C);
+        return;
+    }
+    int h = n / 2;
+    size_t quad = (size_t)h * h;
+    for (int k = 0; k < 2; k++) {
+        for (int q = 0; q < 4; q++) {
+            int i = q / 2, j = q % 2;
+            const double *a = A + (2 * i + k) * quad;
+            const double *b = B + (2 * k + j) * quad;
+            double *c = C + q * quad;
+            if (taskDepth > 0) {
+#pragma omp task firstprivate(a, b, c)
+                morton_recursive(h, a, b, c, leaf, taskDepth - 1);
+            } else {
+                morton_recursive(h, a, b, c, leaf, 0);
+            }
+        }
+        if (taskDepth > 0) {
+#pragma omp taskwait
+        }
+    }
+}
+
+// C = alpha * A * B + beta * C com a recursão em ordem de Morton. Como no Strassen, formas retangulares
+// são completadas com zeros até um quadrado de lado P = leaf * 2^levels (P - max(M, N, K) < 2^levels)
+void morton_gemm(int M, int N, int K, double alpha, const double *A, int lda, const double *B, int ldb,
+                 double beta, double *C, int ldc, int taskDepth) {
+    int levels, leaf;
+    strassen_plan(max(M, max(N, K)), MORTON_LEAF, levels, leaf);
+    int P = leaf << levels;
+    int depth = (omp_get_max_threads() > 1) ? min(taskDepth, levels) : 0;
+    size_t P2 = (size_t)P * P;
+    double *Az = alloc_aligned(P2), *Bz = alloc_aligned(P2), *Cz = alloc_aligned(P2);
+    morton_pack(M, K, A, lda, leaf, levels, Az);
+    morton_pack(K, N, B, ldb, leaf, levels, Bz);
+    fill(Cz, Cz + P2, 0.0);
+
+#pragma omp parallel if (depth > 0)
+#pragma omp single
+    morton_recursive(P, Az, Bz, Cz, leaf, depth);
+
+    morton_unpack(M, N, Cz, leaf, levels, alpha, beta, C, ldc);
+    free(Az);
+    free(Bz);
+    free(Cz);
+}
+
+// API GEMM: C = alpha * op(A) * op(B) + beta * C, com op(X) = X ('N') ou X^T ('T').
+// op(A) é M x K, op(B) é K x N, C é M x N, todas row-major com leading dimensions lda/ldb/ldc.
+// Todos os algoritmos do menu passam por aqui; o algoritmo e os seus parâmetros vêm de GemmOptions.
+enum GemmAlgo {
+    GEMM_STANDARD,
+    GEMM_LINE,
+    GEMM_LINE_EXT_PARALLEL,
+    GEMM_LINE_INT_PARALLEL,
+    GEMM_BLOCK,
+    GEMM_BLOCK_PARALLEL,
+    GEMM_SIMD,
+    GEMM_STRASSEN,
+    GEMM_MORTON
+};
+
+const char *gemm_algo_name(GemmAlgo algo) {
+    switch (algo) {
+        case GEMM_STANDARD: return "Standard";
+        case GEMM_LINE: return "Line";
+        case GEMM_LINE_EXT_PARALLEL: return "LineExtParallel";
+        case GEMM_LINE_INT_PARALLEL: return "LineIntParallel";
+        case GEMM_BLOCK: return "Block";
+        case GEMM_BLOCK_PARALLEL: return "BlockParallel";
+        case GEMM_SIMD: return "Simd";
+        case GEMM_STRASSEN: return "Strassen";
+        case GEMM_MORTON: return "Morton";
+    }
+    return "Unknown";
+}
+
+struct GemmOptions {
+    GemmAlgo algo;
+    int bkSize;                  // Block, BlockParallel e folhas do Strassen (bloco de k)
+    int bm, bn;                  // tiles de C não quadrados em Block/BlockParallel (0 = bkSize)
+    int mc, kc, nc;              // painéis do motor SIMD
+    int crossover;               // Strassen
+    int threads;                 // 0 = omp_get_max_threads()
+    omp_sched_t schedule;        // ciclos paralelos das versões por linha
+    int chunk;
+    vector<double *> replicasB;  // réplicas NUMA de B (só com transB == 'N')
+
+    GemmOptions(GemmAlgo algo = GEMM_SIMD, int bkSize = 0)
+        : algo(algo), bkSize(bkSize > 0 ? bkSize : globalBlockSize), bm(0), bn(0),
+          mc(SIMD_MC), kc(SIMD_KC), nc(SIMD_NC), crossover(strassenCrossover), threads(0),
+          schedule(omp_sched_static), chunk(0) {}
+};
+
+// Perfil de afinação por máquina (gerado por RunAutotune, lido no arranque)
+// Uma entrada por kernel e classe de tamanho (potência de 2 mais próxima de N), medida com maxThreads threads
+// disponíveis; as threads da entrada só são usadas se omp_get_max_threads() for o mesmo da afinação.
+// Formato (texto): linhas "host" e "cpu" (o perfil é ignorado noutro modelo de CPU) e uma linha por entrada:
+//   kernel classe maxThreads bm bk bn threads schedule chunk mflops
+struct TuneEntry {
+    string kernel;
+    int sizeClass, maxThreads;
+    int bm, bk, bn;  // 0 nos kernels sem blocos
+    int threads;     // 0 = omp_get_max_threads()
+    omp_sched_t schedule;
+    int chunk;
+    double mflops;
+};
+
+struct TuneProfile {
+    string path;  // vazio = profiles/<host>.profile, "off" desliga o perfil
+    vector<TuneEntry> entries;
+};
+
+TuneProfile globalProfile = {"", {}};
+
+int size_class(int n) {
+    return 1 << (int)lround(log2((double)max(n, 1)));
+}
+
+string host_name() {
+    char name[256] = {0};
+    gethostname(name, sizeof(name) - 1);
+    return name;
+}
+
+string cpu_model() {
+    ifstream in("/proc/cpuinfo");
+    string line;
+    while (getline(in, line)) {
+        if (line.compare(0, 10, "model name") == 0) {
+            size_t colon = line.find(':');
+            if (colon != string::npos)
+                return line.substr(line.find_first_not_of(" \t", colon + 1));
+        }
+    }
+    return "unknown";
+}
+
+string profile_path() {
+    return globalProfile.path.empty() ? "profiles/" + host_name() + ".profile" : globalProfile.path;
+}
+
+const char *schedule_name(omp_sched_t schedule) {
+    switch ((int)schedule & ~(int)omp_sched_monotonic) {
+        case omp_sched_static: return "static";
+        case omp_sched_dynamic: return "dynamic";
+        case omp_sched_guided: return "guided";
+    }
+    return "auto";
+}
+
+omp_sched_t schedule_from_name(const string &name) {
+    if (name == "dynamic") return omp_sched_dynamic;
+    if (name == "guided") return omp_sched_guided;
+    if (name == "auto") return omp_sched_auto;
+    return omp_sched_static;
+}
+
+bool load_profile(TuneProfile &profile) {
+    profile.entries.clear();
+    if (profile.path == "off")
+        return false;
+    ifstream in(profile_path());
+    if (!in.is_open())
+        return false;
+    string line, cpu;
+    vector<TuneEntry> entries;
+    while (getline(in, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        if (line.compare(0, 4, "cpu ") == 0) {
+            cpu = line.substr(4);
+            continue;
+        }
+        if (line.compare(0, 5, "host ") == 0)
+            continue;
+        istringstream fields(line);
+        TuneEntry e;
+        string schedule;
+        if (fields >> e.kernel >> e.sizeClass >> e.maxThreads >> e.bm >> e.bk >> e.bn >> e.threads >> schedule >> e.chunk >> e.mflops) {
+            e.schedule = schedule_from_name(schedule);
+            entries.push_back(e);
+        }
+    }
+    if (cpu != cpu_model()) {
+        cout << "Tuning profile " << profile_path() << " was made on another CPU (" << cpu << "), ignored" << endl;
+        return false;
+    }
+    profile.entries = entries;
+    return true;
+}
+
+bool save_profile(const TuneProfile &profile) {
+    string path = profile_path();
+    size_t slash = path.rfind('/');
+    if (slash != string::npos)
+        mkdir(path.substr(0, slash).c_str(), 0777);
+    ofstream out(path);
+    if (!out.is_open()) {
+        cerr << "Error writing tuning profile " << path << endl;
+        return false;
+    }
+    out << "# Matrix multiplication tuning profile\n"
+        << "# kernel size_class max_threads bm bk bn threads schedule chunk mflops\n"
+        << "host " << host_name() << "\n"
+        << "cpu " << cpu_model() << "\n";
+    for (const TuneEntry &e : profile.entries)
+        out << e.kernel << " " << e.sizeClass << " " << e.maxThreads << " " << e.bm << " " << e.bk << " " << e.bn << " "
+            << e.threads << " " << schedule_name(e.schedule) << " " << e.chunk << " " << e.mflops << "\n";
+    return true;
+}
+
+const TuneEntry *find_tuned(const string &kernel, int n) {
+    for (const TuneEntry &e : globalProfile.entries)
+        if (e.kernel == kernel && e.sizeClass == size_class(n))
+            return &e;
+    return nullptr;
+}
+
+// Opções do kernel para N: as do perfil se houver entrada para a classe de N, senão as globais
+GemmOptions tuned_options(GemmAlgo algo, int n) {
+    GemmOptions opt(algo);
+    const TuneEntry *e = find_tuned(gemm_algo_name(algo), n);
+    if (e == nullptr)
+        return opt;
+    if (e->bk > 0) {
+        opt.bm = e->bm;
+        opt.bkSize = e->bk;
+        opt.bn = e->bn;
+    }
+    if (e->threads > 0 && e->maxThreads == omp_get_max_threads())
+        opt.threads = e->threads;
+    opt.schedule = e->schedule;
+    opt.chunk = e->chunk;
+    return opt;
+}
+
+// Y (cols x rows) = X^T (X é rows x cols), em blocos de 32 para não saltar linhas de cache
+void transpose(int rows, int cols, const double *X, int ldx, double *Y, int ldy) {
+    for (int ib = 0; ib < rows; ib += 32)
+        for (int jb = 0; jb < cols; jb += 32)
+            for (int i = ib; i < min(ib + 32, rows); i++)
+                for (int j = jb; j < min(jb + 32, cols); j++)
+                    Y[(size_t)j * ldy + i] = X[(size_t)i * ldx + j];
+}
+
+void gemm(char transA, char transB, int M, int N, int K, double alpha, const double *A, int lda,
+          const double *B, int ldb, double beta, double *C, int ldc, const GemmOptions &opt = GemmOptions()) {
+    if (M <= 0 || N <= 0)
+        return;
+    bool tA = (transA == 'T' || transA == 't');
+    bool tB = (transB == 'T' || transB == 't');
+
+    // op(X) transposto é copiado para row-major: O(MK + KN) contra O(MNK) do produto
+    double *At = nullptr, *Bt = nullptr;
+    if (tA && K > 0) {
+        At = alloc_aligned((size_t)M * K);
+        transpose(K, M, A, lda, At, K);
+        A = At;
+        lda = K;
+    }
+    if (tB && K > 0) {
+        Bt = alloc_aligned((size_t)K * N);
+        transpose(N, K, B, ldb, Bt, N);
+        B = Bt;
+        ldb = N;
+    }
+    static const vector<double *> noReplicas;
+    const vector<double *> &replicas = tB ? noReplicas : opt.replicasB;
+    int bm = opt.bm > 0 ? opt.bm : opt.bkSize;
+    int bn = opt.bn > 0 ? opt.bn : opt.bkSize;
+    int savedThreads = omp_get_max_threads();
+    if (opt.threads > 0)
+        omp_set_num_threads(opt.threads);
+
+    if (opt.algo == GEMM_STRASSEN && K > 0 && alpha != 0.0) {
+        strassen_gemm(M, N, K, alpha, A, lda, B, ldb, beta, C, ldc, opt.crossover, opt.bkSize, strassenTaskDepth);
+    } else if (opt.algo == GEMM_MORTON && K > 0 && alpha != 0.0) {
+        morton_gemm(M, N, K, alpha, A, lda, B, ldb, beta, C, ldc, mortonTaskDepth);
+    } else {
+        if (beta != 1.0) {
+            for (int i = 0; i < M; i++)
+                for (int j = 0; j < N; j++)
+                    C[(size_t)i * ldc + j] = (beta == 0.0) ? 0.0 : beta * C[(size_t)i * ldc + j];
+        }
+        if (alpha != 0.0 && K > 0) {
+            switch (opt.algo) {
+                case GEMM_STANDARD:
+                    gemm_standard(M, N, K, alpha, A, lda, B, ldb, C, ldc);
+                    break;
+                case GEMM_LINE:
+                    gemm_line(M, N, K, alpha, A, lda, B, ldb, C, ldc);
+                    break;
+                case GEMM_LINE_EXT_PARALLEL:
+                    gemm_line_ext_parallel(M, N, K, alpha, A, lda, B, ldb, C, ldc, replicas, opt.schedule, opt.chunk);
+                    break;
+                case GEMM_LINE_INT_PARALLEL:
+                    gemm_line_int_parallel(M, N, K, alpha, A, lda, B, ldb, C, ldc, opt.schedule, opt.chunk);
+                    break;
+                case GEMM_BLOCK:
+                    gemm_block(M, N, K, alpha, A, lda, B, ldb, C, ldc, bm, opt.bkSize, bn);
+                    break;
+                case GEMM_BLOCK_PARALLEL:
+                    gemm_block_parallel(M, N, K, alpha, A, lda, B, ldb, C, ldc, bm, opt.bkSize, bn, replicas);
+                    break;
+                case GEMM_SIMD:
+                case GEMM_STRASSEN:
+                case GEMM_MORTON: {
+                    static const MicroKernel uk = select_micro_kernel();
+                    gemm_simd(M, N, K, alpha, A, lda, B, ldb, C, ldc, uk, opt.mc, opt.kc, opt.nc);
+                    }
+                    break;
+            }
+        }
+    }
+    if (opt.threads > 0)
+        omp_set_num_threads(savedThreads);
+    free(At);
+    free(Bt);
+}
+
+// Epílogos fundidos: C = act(alpha * A * B + beta * C + bias), convertido para o tipo de saída Out,
+// aplicados a cada linha (Line) ou tile (Block) de C enquanto o acumulador ainda está em cache, em vez de
+// uma segunda passagem sobre o N x N. Bias, ativação e o uso de beta são parâmetros de template, por isso o
+// ciclo interior não tem ramos; o acumulador é sempre double e a conversão acontece só na escrita final.
+struct ActNone {
+    double operator()(double x) const { return x; }
+};
+struct ActRelu {
+    double operator()(double x) const { return x > 0.0 ? x : 0.0; }
+};
+// GELU com a aproximação por tanh
+struct ActGelu {
+    double operator()(double x) const { return 0.5 * x * (1.0 + tanh(0.7978845608028654 * (x + 0.044715 * x * x * x))); }
+};
+struct ActClamp {
+    double lo, hi;
+    double operator()(double x) const { return x < lo ? lo : (x > hi ? hi : x); }
+};
+
+struct BiasNone {
+    double operator()(int, int) const { return 0.0; }
+};
+struct BiasRow {
+    const double *b;  // um valor por linha de C
+    double operator()(int i, int) const { return b[i]; }
+};
+struct BiasCol {
+    const double *b;  // um valor por coluna de C
+    double operator()(int, int j) const { return b[j]; }
+};
+
+template <typename Bias, typename Act, bool UseBeta>
+struct Epilogue {
+    static const bool useBeta = UseBeta;
+    double alpha, beta;
+    Bias bias;
+    Act act;
+
+    // O mesmo epílogo depois de alpha e beta já aplicados pelo gemm (passagem não fundida)
+    Epilogue<Bias, Act, false> post() const { return {1.0, 0.0, bias, act}; }
+
+    // c[0..n) = linha i de C a partir da coluna j0; acc são os produtos acumulados dessas posições
+    template <typename Out>
+    void apply(int i, int j0, int n, const double *acc, Out *c) const {
+        typedef typename ElemTraits<Out>::acc Store;
+        for (int j = 0; j < n; j++) {
+            double v = alpha * acc[j] + bias(i, j0 + j);
+            if (UseBeta)
+                v += beta * (double)(Store)c[j];
+            c[j] = Out((Store)act(v));
+        }
+    }
+};
+
+template <typename Bias, typename Act, bool UseBeta = false>
+Epilogue<Bias, Act, UseBeta> make_epilogue(double alpha, double beta, Bias bias, Act act) {
+    return {alpha, beta, bias, act};
+}
+
+// tile[0..rows) += A[0..rows, k0..k1) * B[k0..k1, 0..cols). Função à parte com __restrict: dentro da região
+// paralela os operandos seriam lidos pelo contexto partilhado e o compilador não provaria a ausência de aliasing
+static void fused_tile_acc(int rows, int cols, int k0, int k1, const double *__restrict A, int lda, const double *__restrict B,
+                           int ldb, double *__restrict tile, int ldt) {
+    for (int i = 0; i < rows; i++) {
+        double *t = tile + (size_t)i * ldt;
+        for (int k = k0; k < k1; k++) {
+            double a = A[(size_t)i * lda + k];
+            const double *b = B + (size_t)k * ldb;
+            for (int j = 0; j < cols; j++)
+                t[j] += a * b[j];
+        }
+    }
+}
+
+// Por linha: cada linha de C é acumulada num buffer de N doubles (L1/L2) e escrita uma só vez pelo epílogo
+template <typename Out, typename Epi>
+void gemm_line_fused(int M, int N, int K, const double *A, int lda, const double *B, int ldb, Out *C, int ldc, const Epi &epi,
+                     bool parallel) {
+#pragma omp parallel if (parallel)
+    {
+        double *acc = alloc_aligned(N);
+#pragma omp for schedule(static)
+        for (int i = 0; i < M; i++) {
+            fill(acc, acc + N, 0.0);
+            fused_tile_acc(1, N, 0, K, A + (size_t)i * lda, lda, B, ldb, acc, N);
+            epi.apply(i, 0, N, acc, C + (size_t)i * ldc);
+        }
+        free(acc);
+    }
+}
+
+// Em bloco: cada tile bs x bs de C percorre todos os blocos de k num buffer do tile e só então passa pelo
+// epílogo (a ordem dos ciclos é a de gemm_block_parallel). Em paralelo os tiles são repartidos pelas threads
+template <typename Out, typename Epi>
+void gemm_block_fused(int M, int N, int K, const double *A, int lda, const double *B, int ldb, Out *C, int ldc, const Epi &epi,
+                      int bs, bool parallel) {
+    int tilesI = (M + bs - 1) / bs, tilesJ = (N + bs - 1) / bs;
+#pragma omp parallel if (parallel)
+    {
+        double *tile = alloc_aligned((size_t)bs * bs);
+#pragma omp for collapse(2) schedule(dynamic)
+        for (int ti = 0; ti < tilesI; ti++) {
+            for (int tj = 0; tj < tilesJ; tj++) {
+                int iBlock = ti * bs, jBlock = tj * bs;
+                int rows = min(bs, M - iBlock), cols = min(bs, N - jBlock);
+                fill(tile, tile + (size_t)rows * bs, 0.0);
+                for (int kBlock = 0; kBlock < K; kBlock += bs) {
+                    int kMax = min(kBlock + bs, K);
+                    fused_tile_acc(rows, cols, kBlock, kMax, A + (size_t)iBlock * lda, lda, B + jBlock, ldb, tile, bs);
+                }
+                for (int i = 0; i < rows; i++)
+                    epi.apply(iBlock + i, jBlock, cols, tile + (size_t)i * bs, C + (size_t)(iBlock + i) * ldc + jBlock);
+            }
+        }
+        free(tile);
+    }
+}
+
+// C = epi(A * B) num só passo, A M x K e B K x N em double row-major, C no tipo Out.
+// Só Line, Block e as respetivas versões paralelas têm variante fundida (devolve false nos restantes)
+template <typename Out, typename Epi>
+bool gemm_fused(GemmAlgo algo, int M, int N, int K, const double *A, int lda, const double *B, int ldb, Out *C, int ldc,
+                const Epi &epi, int bkSize = 0) {
+    int bs = bkSize > 0 ? bkSize : globalBlockSize;
+    switch (algo) {
+        case GEMM_LINE: gemm_line_fused(M, N, K, A, lda, B, ldb, C, ldc, epi, false); break;
+        case GEMM_LINE_EXT_PARALLEL: gemm_line_fused(M, N, K, A, lda, B, ldb, C, ldc, epi, true); break;
+        case GEMM_BLOCK: gemm_block_fused(M, N, K, A, lda, B, ldb, C, ldc, epi, bs, false); break;
+        case GEMM_BLOCK_PARALLEL: gemm_block_fused(M, N, K, A, lda, B, ldb, C, ldc, epi, bs, true); break;
+        default: return false;
+    }
+    return true;
+}
+
+// Versão não fundida do mesmo epílogo: segunda passagem sobre um C já calculado em double
+template <typename Out, typename Epi>
+void apply_epilogue(int M, int N, const double *acc, int ldacc, Out *C, int ldc, const Epi &epi, bool parallel) {
+#pragma omp parallel for schedule(static) if (parallel)
+    for (int i = 0; i < M; i++)
+        epi.apply(i, 0, N, acc + (size_t)i * ldacc, C + (size_t)i * ldc);
+}
+
+// GEMM em lote: muitos produtos pequenos e independentes (8x8 a 128x128), sem alocação nem inicialização
+// por produto e com uma só região paralela que reparte o lote pelas threads (cada produto é sequencial).
+// Os produtos são C = alpha * A * B + beta * C, row-major e sem transposição, descritos por entrada
+// (ponteiros, tamanhos possivelmente diferentes) ou por passos fixos entre matrizes do mesmo tamanho.
+struct GemmBatchEntry {
+    int M, N, K;
+    const double *A;
+    int lda;
+    const double *B;
+    int ldb;
+    double *C;
+    int ldc;
+};
+
+typedef void (*SmallGemmKernel)(double, const double *, int, const double *, int, double, double *, int);
+
+// Kernel com dimensões em tempo de compilação: C acumula num array local que o compilador mantém em
+// registos e os ciclos são desenrolados por completo até 16 colunas
+template <int M, int N, int K>
+void small_gemm_fixed(double alpha, const double *A, int lda, const double *B, int ldb, double beta, double *C, int ldc) {
+    double acc[M][N] = {};
+    for (int i = 0; i < M; i++) {
+#pragma GCC unroll 8
+        for (int k = 0; k < K; k++) {
+            double a = A[(size_t)i * lda + k];
+#pragma GCC unroll 16
+            for (int j = 0; j < N; j++)
+                acc[i][j] += a * B[(size_t)k * ldb + j];
+        }
+    }
+    for (int i = 0; i < M; i++)
+#pragma GCC unroll 16
+        for (int j = 0; j < N; j++)
+            C[(size_t)i * ldc + j] = alpha * acc[i][j] + (beta == 0.0 ? 0.0 : beta * C[(size_t)i * ldc + j]);
+}
+
+// Tamanhos especializados (quadrados); os restantes usam small_gemm_generic
+SmallGemmKernel small_gemm_kernel(int M, int N, int K) {
+    if (M != N || N != K)
+        return nullptr;
+    switch (M) {
+        case 2: return small_gemm_fixed<2, 2, 2>;
+        case 4: return small_gemm_fixed<4, 4, 4>;
+        case 8: return small_gemm_fixed<8, 8, 8>;
+        case 16: return small_gemm_fixed<16, 16, 16>;
+        case 32: return small_gemm_fixed<32, 32, 32>;
+    }
+    return nullptr;
+}
+
+// Ordem i-k-j da versão por linha, com dimensões em tempo de execução
+void small_gemm_generic(int M, int N, int K, double alpha, const double *A, int lda, const double *B, int ldb,
+                        double beta, double *C, int ldc) {
+    for (int i = 0; i < M; i++) {
+        double *c = C + (size_t)i * ldc;
+        for (int j = 0; j < N; j++)
+            c[j] = (beta == 0.0) ? 0.0 : beta * c[j];
+        for (int k = 0; k < K; k++) {
+            double a = alpha * A[(size_t)i * lda + k];
+            const double *b = B + (size_t)k * ldb;
+            for (int j = 0; j < N; j++)
+                c[j] += a * b[j];
+        }
+    }
+}
+
+// Lote por descritores; o agendamento dinâmico equilibra lotes com tamanhos diferentes.
+// specialized = false força o kernel genérico (referência para as linhas do benchmark)
+void gemm_batch(const GemmBatchEntry *entries, int count, double alpha, double beta, bool specialized = true) {
+#pragma omp parallel for schedule(dynamic, 16)
+    for (int b = 0; b < count; b++) {
+        const GemmBatchEntry &e = entries[b];
+        SmallGemmKernel kernel = specialized ? small_gemm_kernel(e.M, e.N, e.K) : nullptr;
+        if (kernel)
+            kernel(alpha, e.A, e.lda, e.B, e.ldb, beta, e.C, e.ldc);
+        else
+            small_gemm_generic(e.M, e.N, e.K, alpha, e.A, e.lda, e.B, e.ldb, beta, e.C, e.ldc);
+    }
+}
+
+// Lote de count produtos do mesmo tamanho: a matriz b de X começa em X + b * strideX; o kernel é escolhido uma vez
+void gemm_batch_strided(int M, int N, int K, double alpha, const double *A, int lda, size_t strideA, const double *B, int ldb,
+                        size_t strideB, double beta, double *C, int ldc, size_t strideC, int count) {
+    SmallGemmKernel kernel = small_gemm_kernel(M, N, K);
+#pragma omp parallel for schedule(static)
+    for (int b = 0; b < count; b++) {
+        if (kernel)
+            kernel(alpha, A + b * strideA, lda, B + b * strideB, ldb, beta, C + b * strideC, ldc);
+        else
+            small_gemm_generic(M, N, K, alpha, A + b * strideA, lda, B + b * strideB, ldb, beta, C + b * strideC, ldc);
+    }
+}
+
+// Operandos esparsos e estruturados
+// CSR: rowPtr[i]..rowPtr[i+1] indexa colIdx/val da linha i. BCSR: o mesmo por blocos br x bc densos
+// (row-major, completados com zeros nas bordas), com colIdx a guardar a coluna de blocos.
+// Nas versões estruturadas só um triângulo de A é lido: TRMM (C = op(L/U) * B) e SYRK (C = A * A^T)
+// saltam os produtos com zeros ou repetidos (~metade dos flops); SYMM lê e guarda só metade de A,
+// mas faz os mesmos flops que o produto denso.
+
+const double SPARSE_MAX_DENSITY = 0.05;       // gemm_auto usa SpMM até esta densidade de A
+const double BCSR_MIN_FILL = 0.5;             // e BCSR quando os blocos ocupados estão pelo menos meio cheios
+const int BCSR_BLOCK = 4;
+const size_t SPMM_PANEL_BYTES = 256 * 1024;   // painel de colunas de B que deve ficar em L2
+
+struct CsrMatrix {
+    int rows, cols;
+    vector<int> rowPtr, colIdx;
+    vector<double> val;
+};
+
+struct BcsrMatrix {
+    int rows, cols, br, bc;
+    vector<int> rowPtr, colIdx;
+    vector<double> val;
+};
+
+CsrMatrix csr_from_dense(int M, int K, const double *A, int lda) {
+    CsrMatrix csr = {M, K, vector<int>(M + 1, 0), {}, {}};
+    for (int i = 0; i < M; i++) {
+        for (int k = 0; k < K; k++) {
+            double v = A[(size_t)i * lda + k];
+            if (v != 0.0) {
+                csr.colIdx.push_back(k);
+                csr.val.push_back(v);
+            }
+        }
+        csr.rowPtr[i + 1] = (int)csr.val.size();
+    }
+    return csr;
+}
+
+BcsrMatrix bcsr_from_dense(int M, int K, const double *A, int lda, int br, int bc) {
+    int blockRows = (M + br - 1) / br, blockCols = (K + bc - 1) / bc;
+    BcsrMatrix bcsr = {M, K, br, bc, vector<int>(blockRows + 1, 0), {}, {}};
+    for (int I = 0; I < blockRows; I++) {
+        for (int J = 0; J < blockCols; J++) {
+            bool any = false;
+            for (int r = 0; r < br && I * br + r < M && !any; r++)
+                for (int c = 0; c < bc && J * bc + c < K; c++)
+                    if (A[(size_t)(I * br + r) * lda + J * bc + c] != 0.0) {
+                        any = true;
+                        break;
+                    }
+            if (!any)
+                continue;
+            bcsr.colIdx.push_back(J);
+            for (int r = 0; r < br; r++)
+                for (int c = 0; c < bc; c++) {
+                    int i = I * br + r, k = J * bc + c;
+                    bcsr.val.push_back(i < M && k < K ? A[(size_t)i * lda + k] : 0.0);
+                }
+        }
+        bcsr.rowPtr[I + 1] = (int)bcsr.colIdx.size();
+    }
+    return bcsr;
+}
+
+// Colunas de B por painel: K x painel cabe em SPMM_PANEL_BYTES (múltiplo de 8, pelo menos 16)
+int spmm_panel(int K, int N) {
+    int panel = (int)(SPMM_PANEL_BYTES / (sizeof(double) * max(K, 1))) / 8 * 8;
+    return min(N, max(16, panel));
+}
+
+void scale_rows(int M, int N, double beta, double *C, int ldc) {
+#pragma omp for schedule(static)
+    for (int i = 0; i < M; i++)
+        for (int j = 0; j < N; j++)
+            C[(size_t)i * ldc + j] = (beta == 0.0) ? 0.0 : beta * C[(size_t)i * ldc + j];
+}
+
+// C = alpha * A * B + beta * C com A em CSR (M x K) e B denso K x N. Por painéis de colunas de B, para as
+// linhas de B tocadas por colIdx ficarem em cache; linhas repartidas dinamicamente (nnz por linha varia)
+void spmm_csr(const CsrMatrix &A, int N, double alpha, const double *B, int ldb, double beta, double *C, int ldc) {
+    int panel = spmm_panel(A.cols, N);
+#pragma omp parallel
+    {
+        scale_rows(A.rows, N, beta, C, ldc);
+        for (int j0 = 0; j0 < N; j0 += panel) {
+            int j1 = min(N, j0 + panel);
+#pragma omp for schedule(dynamic, 32) nowait
+            for (int i = 0; i < A.rows; i++) {
+                double *c = C + (size_t)i * ldc;
+                for (int p = A.rowPtr[i]; p < A.rowPtr[i + 1]; p++) {
+                    double v = alpha * A.val[p];
+                    const double *b = B + (size_t)A.colIdx[p] * ldb;
+                    for (int j = j0; j < j1; j++)
+                        c[j] += v * b[j];
+                }
+            }
+        }
+    }
+}
+
+// O mesmo com A em BCSR: cada linha de B lida serve as br linhas do bloco
+void spmm_bcsr(const BcsrMatrix &A, int N, double alpha, const double *B, int ldb, double beta, double *C, int ldc) {
+    int panel = spmm_panel(A.cols, N);
+    int blockRows = (int)A.rowPtr.size() - 1;
+#pragma omp parallel
+    {
+        scale_rows(A.rows, N, beta, C, ldc);
+        for (int j0 = 0; j0 < N; j0 += panel) {
+            int j1 = min(N, j0 + panel);
+#pragma omp for schedule(dynamic, 8) nowait
+            for (int I = 0; I < blockRows; I++) {
+                int rows = min(A.br, A.rows - I * A.br);
+                for (int p = A.rowPtr[I]; p < A.rowPtr[I + 1]; p++) {
+                    const double *blk = A.val.data() + (size_t)p * A.br * A.bc;
+                    int k0 = A.colIdx[p] * A.bc;
+                    int cols = min(A.bc, A.cols - k0);
+                    for (int c = 0; c < cols; c++) {
+                        const double *b = B + (size_t)(k0 + c) * ldb;
+                        for (int r = 0; r < rows; r++) {
+                            double v = alpha * blk[r * A.bc + c];
+                            if (v == 0.0)
+                                continue;
+                            double *cr = C + (size_t)(I * A.br + r) * ldc;
+                            for (int j = j0; j < j1; j++)
+                                cr[j] += v * b[j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// C += alpha * A * B com o motor SIMD sequencial (chamado por linha de blocos dentro de um ciclo paralelo)
+void simd_accumulate(int M, int N, int K, double alpha, const double *A, int lda, const double *B, int ldb, double *C, int ldc) {
+    static const MicroKernel uk = select_micro_kernel();
+    if (M > 0 && N > 0 && K > 0)
+        gemm_simd(M, N, K, alpha, A, lda, B, ldb, C, ldc, uk, SIMD_MC, SIMD_KC, SIMD_NC);
+}
+
+// C = alpha * A * B + beta * C denso, com as linhas de blocos repartidas pelas threads: a mesma
+// decomposição de trmm/symm/syrk sem saltar nada (referência densa para esses caminhos)
+void gemm_rows_parallel(int M, int N, int K, double alpha, const double *A, int lda, const double *B, int ldb,
+                        double beta, double *C, int ldc) {
+    int bs = SIMD_MC;
+    int blocks = (M + bs - 1) / bs;
+#pragma omp parallel
+    {
+        scale_rows(M, N, beta, C, ldc);
+#pragma omp for schedule(dynamic, 1)
+        for (int I = 0; I < blocks; I++) {
+            int i0 = I * bs, rows = min(bs, M - i0);
+            simd_accumulate(rows, N, K, alpha, A + (size_t)i0 * lda, lda, B, ldb, C + (size_t)i0 * ldc, ldc);
+        }
+    }
+}
+
+// C = alpha * T * B + beta * C, com T (M x M) triangular inferior (uplo 'L') ou superior ('U'); o outro
+// triângulo não é lido. Cada linha de blocos de C é um produto denso só com os blocos não nulos de T
+// e o bloco diagonal é copiado com zeros no triângulo ignorado
+void trmm(char uplo, int M, int N, double alpha, const double *T, int ldt, const double *B, int ldb, double beta, double *C, int ldc) {
+    bool lower = (uplo == 'L' || uplo == 'l');
+    int bs = SIMD_MC;
+    int blocks = (M + bs - 1) / bs;
+#pragma omp parallel
+    {
+        scale_rows(M, N, beta, C, ldc);
+        double *diag = alloc_aligned((size_t)bs * bs);
+#pragma omp for schedule(dynamic, 1)
+        for (int I = 0; I < blocks; I++) {
+            int i0 = I * bs, rows = min(bs, M - i0);
+            double *Ci = C + (size_t)i0 * ldc;
+            for (int r = 0; r < rows; r++)
+                for (int c = 0; c < rows; c++)
+                    diag[(size_t)r * rows + c] = (lower ? c <= r : c >= r) ? T[(size_t)(i0 + r) * ldt + i0 + c] : 0.0;
+            simd_accumulate(rows, N, rows, alpha, diag, rows, B + (size_t)i0 * ldb, ldb, Ci, ldc);
+            if (lower)
+                simd_accumulate(rows, N, i0, alpha, T + (size_t)i0 * ldt, ldt, B, ldb, Ci, ldc);
+            else
+                simd_accumulate(rows, N, M - i0 - rows, alpha, T + (size_t)i0 * ldt + i0 + rows, ldt,
+                                B + (size_t)(i0 + rows) * ldb, ldb, Ci, ldc);
+        }
+        free(diag);
+    }
+}
+
+// C = alpha * S * B + beta * C, com S (M x M) simétrica de que só o triângulo inferior é lido: cada linha de
+// blocos monta o seu painel de S (linhas à esquerda da diagonal, colunas abaixo dela transpostas)
+void symm(int M, int N, double alpha, const double *S, int lds, const double *B, int ldb, double beta, double *C, int ldc) {
+    int bs = SIMD_MC;
+    int blocks = (M + bs - 1) / bs;
+#pragma omp parallel
+    {
+        scale_rows(M, N, beta, C, ldc);
+        double *panel = alloc_aligned((size_t)bs * M);
+#pragma omp for schedule(dynamic, 1)
+        for (int I = 0; I < blocks; I++) {
+            int i0 = I * bs, rows = min(bs, M - i0);
+            for (int r = 0; r < rows; r++)
+                copy(S + (size_t)(i0 + r) * lds, S + (size_t)(i0 + r) * lds + i0 + r + 1, panel + (size_t)r * M);
+            for (int k = i0 + 1; k < M; k++) {
+                const double *s = S + (size_t)k * lds + i0;
+                for (int r = 0; r < rows && i0 + r < k; r++)
+                    panel[(size_t)r * M + k] = s[r];
+            }
+            simd_accumulate(rows, N, M, alpha, panel, M, B, ldb, C + (size_t)i0 * ldc, ldc);
+        }
+        free(panel);
+    }
+}
+
+// C = alpha * A * A^T + beta * C (A é N x K, C é N x N simétrica): só os blocos do triângulo inferior são
+// calculados e o superior é copiado no fim
+void syrk(int N, int K, double alpha, const double *A, int lda, double beta, double *C, int ldc) {
+    double *At = alloc_aligned((size_t)K * N);
+    transpose(N, K, A, lda, At, N);
+    int bs = SIMD_MC;
+    int blocks = (N + bs - 1) / bs;
+#pragma omp parallel
+    {
+        scale_rows(N, N, beta, C, ldc);
+#pragma omp for schedule(dynamic, 1)
+        for (int I = 0; I < blocks; I++) {
+            int i0 = I * bs, rows = min(bs, N - i0);
+            simd_accumulate(rows, i0 + rows, K, alpha, A + (size_t)i0 * lda, lda, At, N, C + (size_t)i0 * ldc, ldc);
+        }
+#pragma omp for schedule(static)
+        for (int i = 0; i < N; i++)
+            for (int j = i + 1; j < N; j++)
+                C[(size_t)i * ldc + j] = C[(size_t)j * ldc + i];
+    }
+    free(At);
+}
+
+// Estrutura de A (M x K): elementos não nulos e se é triangular; percorre A uma vez (O(MK))
+struct MatrixStructure {
+    size_t nnz;
+    bool lower, upper;  // todos os zeros acima (lower) / abaixo (upper) da diagonal; só para A quadrada
+};
+
+MatrixStructure analyze_structure(int M, int K, const double *A, int lda) {
+    MatrixStructure s = {0, M == K, M == K};
+    for (int i = 0; i < M; i++)
+        for (int k = 0; k < K; k++)
+            if (A[(size_t)i * lda + k] != 0.0) {
+                s.nnz++;
+                if (k > i) s.lower = false;
+                if (k < i) s.upper = false;
+            }
+    return s;
+}
+
+// Fração dos elementos dos blocos BCSR ocupados que são não nulos
+double bcsr_fill(const BcsrMatrix &A) {
+    size_t stored = A.val.size(), nnz = 0;
+    for (double v : A.val)
+        if (v != 0.0) nnz++;
+    return stored > 0 ? (double)nnz / stored : 0.0;
+}
+
+// C = A * B (A M x K, B K x N, row-major) pelo caminho que a estrutura de A permite: SpMM (BCSR se os blocos
+// estiverem cheios, senão CSR) até SPARSE_MAX_DENSITY, TRMM se A for triangular, senão o motor SIMD denso
+// repartido por linhas de blocos. 'chosen' recebe o caminho e 'usefulOps' os flops sem zeros conhecidos (2 nnz(A) N)
+void gemm_auto(int M, int N, int K, const double *A, int lda, const double *B, int ldb, double *C, int ldc,
+               string *chosen = nullptr, double *usefulOps = nullptr) {
+    MatrixStructure s = analyze_structure(M, K, A, lda);
+    double density = (M > 0 && K > 0) ? (double)s.nnz / ((double)M * K) : 1.0;
+    string path;
+    if (density <= SPARSE_MAX_DENSITY) {
+        BcsrMatrix bcsr = bcsr_from_dense(M, K, A, lda, BCSR_BLOCK, BCSR_BLOCK);
+        if (bcsr_fill(bcsr) >= BCSR_MIN_FILL) {
+            spmm_bcsr(bcsr, N, 1.0, B, ldb, 0.0, C, ldc);
+            path = "BCSR";
+        } else {
+            spmm_csr(csr_from_dense(M, K, A, lda), N, 1.0, B, ldb, 0.0, C, ldc);
+            path = "CSR";
+        }
+    } else if (s.lower || s.upper) {
+        trmm(s.lower ? 'L' : 'U', M, N, 1.0, A, lda, B, ldb, 0.0, C, ldc);
+        path = s.lower ? "TRMM-L" : "TRMM-U";
+    } else {
+        gemm_rows_parallel(M, N, K, 1.0, A, lda, B, ldb, 0.0, C, ldc);
+        path = "Dense";
+    }
+    if (chosen)
+        *chosen = path;
+    if (usefulOps)
+        *usefulOps = 2.0 * (double)s.nnz * N;
+}
+
+// Serviço GEMM assíncrono
+// Um conjunto fixo de threads de trabalho (criadas uma vez, sem regiões OpenMP por pedido) consome pedidos
+// de uma fila MPMC limitada sem locks. Uma thread que acorda leva também até maxBatch pedidos pequenos já
+// na fila (menos trocas de contexto e acessos à fila por pedido) e corre-os agrupados por tamanho, com o
+// kernel especializado do lote; cada pedido é dado por terminado logo a seguir ao seu produto.
+// Os pedidos grandes correm no motor SIMD sequencial. O mutex só é usado para adormecer/acordar threads.
+
+const int SERVICE_SPIN = 2000;                // tentativas antes de adormecer
+const long SERVICE_SMALL_FLOPS = 64 * 64 * 64;  // M * N * K até onde um pedido é agrupado
+
+// C = A * B (row-major, sem transposição); 'done' é chamado pela thread de trabalho no fim
+struct GemmTask {
+    int M, N, K;
+    const double *A;
+    int lda;
+    const double *B;
+    int ldb;
+    double *C;
+    int ldc;
+    function<void()> done;
+};
+
+// Fila MPMC limitada de Vyukov: cada célula tem um número de sequência que diz se está livre para a
+// posição 'tail' (escrita) ou cheia para a posição 'head' (leitura); capacidade potência de 2
+struct TaskQueue {
+    struct Cell {
+        atomic<size_t> seq;
+        GemmTask *task;
+    };
+    vector<Cell> cells;
+    size_t mask;
+    alignas(64) atomic<size_t> head;
+    alignas(64) atomic<size_t> tail;
+
+    explicit TaskQueue(size_t capacity) : cells(capacity), mask(capacity - 1), head(0), tail(0) {
+        for (size_t i = 0; i < capacity; i++)
+            cells[i].seq.store(i, memory_order_relaxed);
+    }
+
+    bool push(GemmTask *task) {
+        size_t pos = tail.load(memory_order_relaxed);
+        for (;;) {
+            Cell &cell = cells[pos & mask];
+            intptr_t diff = (intptr_t)cell.seq.load(memory_order_acquire) - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    cell.task = task;
+                    cell.seq.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // cheia
+            } else {
+                pos = tail.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(GemmTask *&task) {
+        size_t pos = head.load(memory_order_relaxed);
+        for (;;) {
+            Cell &cell = cells[pos & mask];
+            intptr_t diff = (intptr_t)cell.seq.load(memory_order_acquire) - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    task = cell.task;
+                    cell.seq.store(pos + mask + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // vazia
+            } else {
+                pos = head.load(memory_order_relaxed);
+            }
+        }
+    }
+};
+
+class GemmService {
+public:
+    // capacity é arredondada para potência de 2; submit falha (sem bloquear) com a fila cheia
+    GemmService(int workers, int maxBatch, size_t capacity)
+        : queue(round_pow2(capacity)), maxBatch(max(1, maxBatch)) {
+        for (int w = 0; w < max(1, workers); w++)
+            threads.emplace_back([this] { worker(); });
+    }
+
+    // Termina os pedidos já submetidos e junta as threads
+    ~GemmService() {
+        {
+            lock_guard<mutex> guard(sleepLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (thread &t : threads)
+            t.join();
+    }
+
+    // task tem de viver até task->done ser chamado
+    bool submit(GemmTask *task) {
+        if (!queue.push(task))
+            return false;
+        pending.fetch_add(1);
+        if (sleepers.load() > 0) {
+            lock_guard<mutex> guard(sleepLock);
+            wake.notify_one();
+        }
+        return true;
+    }
+
+    // Variante com future: espera por espaço na fila e completa o future no fim do produto
+    future<void> submit(int M, int N, int K, const double *A, int lda, const double *B, int ldb, double *C, int ldc) {
+        auto result = make_shared<promise<void>>();
+        GemmTask *task = new GemmTask{M, N, K, A, lda, B, ldb, C, ldc, nullptr};
+        task->done = [task, result] {
+            delete task;
+            result->set_value();
+        };
+        future<void> f = result->get_future();
+        while (!submit(task))
+            this_thread::yield();
+        return f;
+    }
+
+    // Pedidos executados e quantos saíram de um lote com mais de um pedido
+    long executed() const { return executedCount.load(); }
+    long coalesced() const { return coalescedCount.load(); }
+
+private:
+    TaskQueue queue;
+    int maxBatch;
+    vector<thread> threads;
+    atomic<long> pending{0};
+    atomic<int> sleepers{0};
+    atomic<long> executedCount{0}, coalescedCount{0};
+    bool stopping = false;
+    mutex sleepLock;
+    condition_variable wake;
+
+    static size_t round_pow2(size_t n) {
+        size_t p = 2;
+        while (p < n)
+            p <<= 1;
+        return p;
+    }
+
+    static bool is_small(const GemmTask *t) { return (long)t->M * t->N * t->K <= SERVICE_SMALL_FLOPS; }
+
+    static void run(GemmTask *t) {
+        SmallGemmKernel kernel = is_small(t) ? small_gemm_kernel(t->M, t->N, t->K) : nullptr;
+        if (kernel)
+            kernel(1.0, t->A, t->lda, t->B, t->ldb, 0.0, t->C, t->ldc);
+        else if (is_small(t))
+            small_gemm_generic(t->M, t->N, t->K, 1.0, t->A, t->lda, t->B, t->ldb, 0.0, t->C, t->ldc);
+        else
+            gemm('N', 'N', t->M, t->N, t->K, 1.0, t->A, t->lda, t->B, t->ldb, 0.0, t->C, t->ldc, GemmOptions(GEMM_SIMD));
+        // done pode apagar t (variante com future), por isso sai da tarefa antes de ser chamado
+        function<void()> done = move(t->done);
+        if (done)
+            done();
+    }
+
+    // Espera por trabalho: primeiro em espera ativa, depois na variável de condição; false ao terminar
+    bool wait_for_work() {
+        for (int spin = 0; spin < SERVICE_SPIN; spin++) {
+            if (pending.load() > 0)
+                return true;
+#if defined(__x86_64__) || defined(__i386__)
+            _mm_pause();
+#endif
+        }
+        unique_lock<mutex> guard(sleepLock);
+        sleepers.fetch_add(1);
+        wake.wait(guard, [this] { return stopping || pending.load() > 0; });
+        sleepers.fetch_sub(1);
+        return pending.load() > 0 || !stopping;
+    }
+
+    void worker() {
+        omp_set_num_threads(1);
+        vector<GemmTask *> batch;
+        for (;;) {
+            GemmTask *task;
+            if (!queue.pop(task)) {
+                if (!wait_for_work())
+                    return;
+                continue;
+            }
+            batch.assign(1, task);
+            while (is_small(batch[0]) && (int)batch.size() < maxBatch && queue.pop(task)) {
+                batch.push_back(task);
+                if (!is_small(task))
+                    break;
+            }
+            pending.fetch_sub((long)batch.size());
+            // Agrupados por tamanho para reutilizar o mesmo kernel; a ordem de chegada mantém-se em cada grupo
+            stable_sort(batch.begin(), batch.end(), [](const GemmTask *a, const GemmTask *b) {
+                return make_tuple(a->M, a->N, a->K) < make_tuple(b->M, b->N, b->K);
+            });
+            for (GemmTask *t : batch)
+                run(t);
+            executedCount.fetch_add((long)batch.size());
+            if (batch.size() > 1)
+                coalescedCount.fetch_add((long)batch.size());
+        }
+    }
+};
+
+double max_abs_diff(const double *X, const double *Y, size_t count) {
+    double err = 0.0;
+    for (size_t i = 0; i < count; i++)
+        err = max(err, fabs(X[i] - Y[i]));
+    return err;
+}
+
+// Erro máximo de Strassen contra o produto clássico (motor SIMD), fora da medição de tempo
+double strassen_error(int n, const double *A, const double *B, const double *C) {
+    double *reference = alloc_aligned((size_t)n * n);
+    gemm('N', 'N', n, n, n, 1.0, A, n, B, n, 0.0, reference, n, GemmOptions(GEMM_SIMD));
+    double err = max_abs_diff(C, reference, (size_t)n * n);
+    free(reference);
+    return err;
+}
+
+// Harness: mede um produto quadrado m_ar x m_ar com o algoritmo de opt sobre matrizes da arena
+double TimeSquareGemm(int m_ar, int m_br, GemmOptions opt, bool numa, double beta = 1.0) {
+    Matrix A, B, C;
+    globalArena.views(m_ar, m_br, m_ar, A, B, C);
+    double *matrixA = A.data, *matrixB = B.data, *matrixC = C.data;
+    if (numa) {
+        initialize_matrices_numa(matrixA, matrixB, matrixC, m_ar, m_br);
+        opt.replicasB = replicate_B_per_node(matrixB, m_br);
+    } else {
+        initialize_matrices(matrixA, matrixB, matrixC, m_ar, m_br);
+    }
+
+    double start_time = omp_get_wtime();
+    gemm('N', 'N', m_ar, m_br, m_ar, 1.0, matrixA, m_ar, matrixB, m_br, beta, matrixC, m_br, opt);
+    double elapsed = omp_get_wtime() - start_time;
+
+    cout << "Result matrix (first row): ";
+    for (int j = 0; j < min(10, m_br); j++)
+        cout << matrixC[j] << " ";
+    cout << endl;
+
+    free_replicas(opt.replicasB);
+    return elapsed;
+}
+
+// Algoritmo standard (i-j-k)
+double OnMult(int m_ar, int m_br) {
+    return TimeSquareGemm(m_ar, m_br, GemmOptions(GEMM_STANDARD), false);
+}
+
+// Multiplicação por linha
+double OnMultLine(int m_ar, int m_br) {
+    return TimeSquareGemm(m_ar, m_br, GemmOptions(GEMM_LINE), false);
+}
+
+// Multiplicação por linha paralela externa (threads e schedule do perfil de afinação, se existir)
+double OnMultLineExtParallel(int m_ar, int m_br) {
+    return TimeSquareGemm(m_ar, m_br, tuned_options(GEMM_LINE_EXT_PARALLEL, m_ar), true);
+}
+
+// Multiplicação por linha paralela interna
+double OnMultLineIntParallel(int m_ar, int m_br) {
+    return TimeSquareGemm(m_ar, m_br, tuned_options(GEMM_LINE_INT_PARALLEL, m_ar), true);
+}
+
+// Multiplicação em bloco; bkSize <= 0 usa os blocos do perfil de afinação (ou o bloco global)
+double OnMultBlock(int m_ar, int m_br, int bkSize) {
+    GemmOptions opt = bkSize > 0 ? GemmOptions(GEMM_BLOCK, bkSize) : tuned_options(GEMM_BLOCK, m_ar);
+    return TimeSquareGemm(m_ar, m_br, opt, false);
+}
+
+// Multiplicação em bloco paralela (tasks sobre tiles 2D)
+double OnMultBlockParallel(int m_ar, int m_br, int bkSize) {
+    GemmOptions opt = bkSize > 0 ? GemmOptions(GEMM_BLOCK_PARALLEL, bkSize) : tuned_options(GEMM_BLOCK_PARALLEL, m_ar);
+    return TimeSquareGemm(m_ar, m_br, opt, true);
+}
+
+// Multiplicação com micro-kernel SIMD
+double OnMultSimd(int m_ar, int m_br) {
+    MicroKernel uk = select_micro_kernel();
+    cout << "Micro-kernel: " << uk.isa << " (" << uk.mr << "x" << uk.nr << ")" << endl;
+    return TimeSquareGemm(m_ar, m_br, GemmOptions(GEMM_SIMD), false);
+}
+
+// Multiplicação em bloco com painéis empacotados (MC/KC/NC independentes)
+double OnMultBlockPacked(int m_ar, int m_br, int mc, int kc, int nc) {
+    MicroKernel uk = select_micro_kernel();
+    cout << "Panels MC/KC/NC: " << mc << "/" << kc << "/" << nc << " - Micro-kernel: " << uk.isa << endl;
+    GemmOptions opt(GEMM_SIMD);
+    opt.mc = mc;
+    opt.kc = kc;
+    opt.nc = nc;
+    return TimeSquareGemm(m_ar, m_br, opt, false);
+}
+
+// Multiplicação Strassen com crossover para o kernel em bloco
+double OnMultStrassen(int m_ar, int m_br, int crossover) {
+    GemmOptions opt(GEMM_STRASSEN);
+    opt.crossover = crossover;
+    double elapsed = TimeSquareGemm(m_ar, m_br, opt, false, 0.0);
+
+    Matrix A, B, C;
+    globalArena.views(m_ar, m_br, m_ar, A, B, C);
+    cout << "Max abs error vs classical: " << strassen_error(m_ar, A.data, B.data, C.data) << endl;
+    return elapsed;
+}
+
+// Multiplicação cache-oblivious em ordem de Morton (sem bloco a afinar)
+double OnMultMorton(int m_ar, int m_br) {
+    int levels, leaf;
+    strassen_plan(m_ar, MORTON_LEAF, levels, leaf);
+    cout << "Morton: " << levels << " level(s), leaf " << leaf << ", padded to " << (leaf << levels) << ", task depth "
+         << (omp_get_max_threads() > 1 ? min(mortonTaskDepth, levels) : 0) << endl;
+    return TimeSquareGemm(m_ar, m_br, GemmOptions(GEMM_MORTON), false);
+}
+
+// Produto retangular op(A) * op(B) com op(A) M x K e op(B) K x N; com 'T' o operando é guardado
+// transposto (K x M ou N x K). Os valores seguem initialize_matrices: op(A) = 1 e a linha k de op(B) = k + 1.
+double OnMultRect(int M, int N, int K, char transA, char transB, GemmAlgo algo) {
+    Matrix A, B, C;
+    globalArena.views(M, N, K, A, B, C);
+    bool tA = (transA == 'T' || transA == 't');
+    bool tB = (transB == 'T' || transB == 't');
+    int lda = tA ? M : K;
+    int ldb = tB ? K : N;
+    fill(A.data, A.data + (size_t)M * K, 1.0);
+    for (int k = 0; k < K; k++)
+        for (int j = 0; j < N; j++)
+            B.data[tB ? (size_t)j * ldb + k : (size_t)k * ldb + j] = (double)(k + 1);
+    fill(C.data, C.data + (size_t)M * N, 0.0);
+
+    GemmOptions opt(algo);
+    double beta = (algo == GEMM_STRASSEN) ? 0.0 : 1.0;
+    double start_time = omp_get_wtime();
+    gemm(transA, transB, M, N, K, 1.0, A.data, lda, B.data, ldb, beta, C.data, N, opt);
+    double elapsed = omp_get_wtime() - start_time;
+
+    cout << "Result matrix (first row): ";
+    for (int j = 0; j < min(10, N); j++)
+        cout << C.data[j] << " ";
+    cout << endl;
+    cout << gemm_algo_name(algo) << " - " << M << "x" << K << (tA ? "^T" : "") << " * " << K << "x" << N << (tB ? "^T" : "")
+         << " - Time: " << elapsed << " s - MFlops: " << 2.0 * M * N * K / (elapsed * 1.0e6) << endl;
+    return elapsed;
+}
+
+// Precisão reduzida
+// As entradas são geradas em double (aleatórias em [-1, 1], semente fixa) e convertidas para T; o erro compara
+// C com o produto em double das entradas originais, em até 16 linhas espaçadas, normalizado por
+// sum_k |a_ik| |b_kj|. Inclui por isso o arredondamento das entradas e a acumulação (ordem de u de T).
+
+template <typename T, typename Acc>
+bool gemm_typed(GemmAlgo algo, int n, const T *A, const T *B, Acc *C, int bkSize) {
+    switch (algo) {
+        case GEMM_STANDARD: gemm_standard(n, n, n, 1.0, A, n, B, n, C, n); break;
+        case GEMM_LINE: gemm_line(n, n, n, 1.0, A, n, B, n, C, n); break;
+        case GEMM_LINE_EXT_PARALLEL: gemm_line_ext_parallel(n, n, n, 1.0, A, n, B, n, C, n, vector<T *>()); break;
+        case GEMM_LINE_INT_PARALLEL: gemm_line_int_parallel(n, n, n, 1.0, A, n, B, n, C, n); break;
+        case GEMM_BLOCK: gemm_block(n, n, n, 1.0, A, n, B, n, C, n, bkSize, bkSize, bkSize); break;
+        case GEMM_BLOCK_PARALLEL: gemm_block_parallel(n, n, n, 1.0, A, n, B, n, C, n, bkSize, bkSize, bkSize, vector<T *>()); break;
+        default: return false;  // Simd, Strassen e Morton só existem em double
+    }
+    return true;
+}
+
+struct TypedResult {
+    double time;
+    double error;  // erro relativo máximo contra o produto em double
+};
+
+template <typename T>
+bool TimeTypedGemm(int n, GemmAlgo algo, int bkSize, TypedResult &res) {
+    typedef typename ElemTraits<T>::acc Acc;
+    size_t count = (size_t)n * n;
+    double *refA = alloc_aligned(count), *refB = alloc_aligned(count);
+    srand(12345);
+    for (size_t i = 0; i < count; i++) {
+        refA[i] = 2.0 * rand() / RAND_MAX - 1.0;
+        refB[i] = 2.0 * rand() / RAND_MAX - 1.0;
+    }
+    T *A = alloc_aligned<T>(count), *B = alloc_aligned<T>(count);
+    Acc *C = alloc_aligned<Acc>(count);
+    for (size_t i = 0; i < count; i++) {
+        A[i] = (T)refA[i];
+        B[i] = (T)refB[i];
+        C[i] = 0;
+    }
+
+    double start_time = omp_get_wtime();
+    bool ok = gemm_typed(algo, n, A, B, C, bkSize);
+    res.time = omp_get_wtime() - start_time;
+
+    res.error = 0.0;
+    if (ok) {
+        cout << "Result matrix (first row): ";
+        for (int j = 0; j < min(10, n); j++)
+            cout << (double)C[j] << " ";
+        cout << endl;
+        int rows = min(n, 16);
+        vector<double> ref(n), mag(n);
+        for (int r = 0; r < rows; r++) {
+            size_t i = (size_t)r * n / rows;
+            fill(ref.begin(), ref.end(), 0.0);
+            fill(mag.begin(), mag.end(), 0.0);
+            for (int k = 0; k < n; k++) {
+                double a = refA[i * n + k];
+                for (int j = 0; j < n; j++) {
+                    ref[j] += a * refB[(size_t)k * n + j];
+                    mag[j] += fabs(a) * fabs(refB[(size_t)k * n + j]);
+                }
+            }
+            for (int j = 0; j < n; j++)
+                if (mag[j] > 0)
+                    res.error = max(res.error, fabs((double)C[i * n + j] - ref[j]) / mag[j]);
+        }
+    }
+    free(refA);
+    free(refB);
+    free(A);
+    free(B);
+    free(C);
+    return ok;
+}
+
+const vector<string> DTYPES = {"double", "float", "bf16", "fp16"};
+
+double dtype_unit_roundoff(const string &dtype) {
+    if (dtype == "float") return ElemTraits<float>::unit_roundoff();
+    if (dtype == "bf16") return ElemTraits<bf16>::unit_roundoff();
+    if (dtype == "fp16") return ElemTraits<fp16>::unit_roundoff();
+    return ElemTraits<double>::unit_roundoff();
+}
+
+// Corre o algoritmo com o tipo de elemento pedido; devolve false se não houver versão para esse tipo
+bool RunTypedGemm(const string &dtype, GemmAlgo algo, int n, int bkSize, TypedResult &res) {
+    if (dtype == "double") return TimeTypedGemm<double>(n, algo, bkSize, res);
+    if (dtype == "float") return TimeTypedGemm<float>(n, algo, bkSize, res);
+    if (dtype == "bf16") return TimeTypedGemm<bf16>(n, algo, bkSize, res);
+    if (dtype == "fp16") return TimeTypedGemm<fp16>(n, algo, bkSize, res);
+    return false;
+}
+
+bool gemm_algo_from_name(const string &name, GemmAlgo &algo) {
+    for (int a = GEMM_STANDARD; a <= GEMM_MORTON; a++) {
+        if (name == gemm_algo_name((GemmAlgo)a)) {
+            algo = (GemmAlgo)a;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Compara o mesmo algoritmo em todos os tipos de elemento: tempo, MFlops e erro face ao double
+void ComparePrecisions(int n, GemmAlgo algo, int bkSize) {
+    cout << "\n" << gemm_algo_name(algo) << " N=" << n << endl;
+    cout << setw(8) << "dtype" << setw(12) << "time(s)" << setw(12) << "MFlops" << setw(14) << "rel. error" << setw(14) << "unit roundoff" << endl;
+    for (const string &dtype : DTYPES) {
+        TypedResult res;
+        if (!RunTypedGemm(dtype, algo, n, bkSize, res)) {
+            cout << gemm_algo_name(algo) << " has no templated kernel (double only via the main menu)" << endl;
+            return;
+        }
+        cout << setw(8) << dtype << setw(12) << res.time << setw(12) << 2.0 * n * n * n / (res.time * 1.0e6) << setw(14)
+             << res.error << setw(14) << dtype_unit_roundoff(dtype) << endl;
+    }
+}
+
+// Verificação
+// initialize_matrices dá A = 1 e linha i de B = i + 1, por isso todas as linhas de C são iguais e uma
+// transposição trocada ou uma corrida entre threads passa despercebida. Aqui as entradas são aleatórias
+// (semente fixa) ou adversariais e C é comparado com o produto em long double das mesmas entradas:
+//  - N <= VERIFY_FULL_MAX: todos os elementos, |c - r| <= 2 gamma_K sum_k |a_ik| |b_kj| (gamma_K = K u / (1 - K u));
+//  - N maior: Freivalds, C x contra A (B x) para vetores x aleatórios, O(N^2) por vetor.
+// Strassen não cumpre o limite por componente e usa o limite em norma (Higham, Teorema 23.3):
+// max |c - r| <= 12^níveis (n0^2 + 5 n0) u max|A| max|B|, com n0 a dimensão das folhas (também com folga 2).
+const int VERIFY_FULL_MAX = 640;
+const int VERIFY_FREIVALDS_TRIALS = 2;
+
+enum VerifyInput { INPUT_RANDOM, INPUT_ADVERSARIAL };
+
+const char *verify_input_name(VerifyInput kind) {
+    return kind == INPUT_RANDOM ? "random" : "adversarial";
+}
+
+// random: uniforme em [-1, 1]. adversarial: sinal aleatório e magnitude 2^e com e em [-20, 20], com ~1/8 de zeros:
+// somas com cancelamento e parcelas de ordens de grandeza muito diferentes
+void fill_verify_input(VerifyInput kind, double *X, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (kind == INPUT_RANDOM) {
+            X[i] = 2.0 * rand() / RAND_MAX - 1.0;
+        } else {
+            int r = rand();
+            X[i] = (r % 8 == 0) ? 0.0 : ldexp((r & 8) ? -1.0 : 1.0, rand() % 41 - 20);
+        }
+    }
+}
+
+// Entradas de um caso (op(A) e op(B) lógicos, N x N) e, para N pequeno, a referência e sum |a||b| por elemento
+struct VerifyCase {
+    int n;
+    VerifyInput kind;
+    vector<double> A, B;
+    vector<double> ref, mag;
+    double maxA, maxB;
+};
+
+VerifyCase make_verify_case(int n, VerifyInput kind) {
+    VerifyCase vc;
+    size_t count = (size_t)n * n;
+    vc.n = n;
+    vc.kind = kind;
+    vc.A.resize(count);
+    vc.B.resize(count);
+    srand(12345 + kind);
+    fill_verify_input(kind, vc.A.data(), count);
+    fill_verify_input(kind, vc.B.data(), count);
+    vc.maxA = vc.maxB = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        vc.maxA = max(vc.maxA, fabs(vc.A[i]));
+        vc.maxB = max(vc.maxB, fabs(vc.B[i]));
+    }
+    if (n <= VERIFY_FULL_MAX) {
+        vc.ref.resize(count);
+        vc.mag.resize(count);
+        vector<long double> ref(n), mag(n);
+        for (int i = 0; i < n; i++) {
+            fill(ref.begin(), ref.end(), 0.0L);
+            fill(mag.begin(), mag.end(), 0.0L);
+            for (int k = 0; k < n; k++) {
+                long double a = vc.A[(size_t)i * n + k];
+                const double *b = &vc.B[(size_t)k * n];
+                for (int j = 0; j < n; j++) {
+                    ref[j] += a * b[j];
+                    mag[j] += fabsl(a) * fabs(b[j]);
+                }
+            }
+            for (int j = 0; j < n; j++) {
+                vc.ref[(size_t)i * n + j] = (double)ref[j];
+                vc.mag[(size_t)i * n + j] = (double)mag[j];
+            }
+        }
+    }
+    return vc;
+}
+
+struct VerifyResult {
+    bool pass;
+    const char *method;  // "full" ou "freivalds"
+    double ratio;        // maior erro / tolerância (passa com <= 1)
+    double maxUlp;       // só na comparação completa
+};
+
+// Distância em ulps: os padrões de bits de doubles com sinal são mapeados para uma ordem inteira contínua
+double ulp_distance(double x, double y) {
+    int64_t a, b;
+    memcpy(&a, &x, sizeof(a));
+    memcpy(&b, &y, sizeof(b));
+    if (a < 0) a = INT64_MIN - a;
+    if (b < 0) b = INT64_MIN - b;
+    return fabs((double)a - (double)b);
+}
+
+// Acumula um erro na verificação; NaN falha sempre
+void verify_accumulate(VerifyResult &res, double err, double tol) {
+    double r = tol > 0 ? err / tol : (err == 0 ? 0.0 : INFINITY);
+    if (!(err <= tol))
+        res.pass = false;
+    if (!(r <= res.ratio))
+        res.ratio = r;
+}
+
+// Corre gemm com as opções de opt sobre o caso (com 'T' o operando é guardado transposto) e verifica C
+VerifyResult VerifyGemm(const VerifyCase &vc, GemmOptions opt, char transA, char transB) {
+    int n = vc.n;
+    size_t count = (size_t)n * n;
+    bool tA = (transA == 'T' || transA == 't');
+    bool tB = (transB == 'T' || transB == 't');
+    double *A = alloc_aligned(count), *B = alloc_aligned(count), *C = alloc_aligned(count);
+    if (tA) transpose(n, n, vc.A.data(), n, A, n);
+    else copy(vc.A.begin(), vc.A.end(), A);
+    if (tB) transpose(n, n, vc.B.data(), n, B, n);
+    else copy(vc.B.begin(), vc.B.end(), B);
+    fill(C, C + count, NAN);  // beta = 0 tem de escrever todos os elementos
+
+    // Os paralelos correm como no menu, com réplicas NUMA de B quando a política as pede
+    bool numa = opt.algo == GEMM_LINE_EXT_PARALLEL || opt.algo == GEMM_LINE_INT_PARALLEL || opt.algo == GEMM_BLOCK_PARALLEL;
+    if (numa && !tB)
+        opt.replicasB = replicate_B_per_node(B, n);
+    gemm(transA, transB, n, n, n, 1.0, A, n, B, n, 0.0, C, n, opt);
+    free_replicas(opt.replicasB);
+
+    double u = ElemTraits<double>::unit_roundoff();
+    double gamma = 2.0 * n * u / (1.0 - n * u);
+    double normTol = -1.0;
+    if (opt.algo == GEMM_STRASSEN) {
+        int levels, leaf;
+        strassen_plan(n, opt.crossover, levels, leaf);
+        if (levels > 0)
+            normTol = 2.0 * pow(12.0, levels) * ((double)leaf * leaf + 5.0 * leaf) * u * vc.maxA * vc.maxB;
+    }
+
+    VerifyResult res = {true, "full", 0.0, 0.0};
+    if (n <= VERIFY_FULL_MAX) {
+        for (size_t i = 0; i < count; i++) {
+            double err = fabs(C[i] - vc.ref[i]);
+            verify_accumulate(res, err, normTol >= 0 ? normTol : gamma * vc.mag[i]);
+            res.maxUlp = max(res.maxUlp, ulp_distance(C[i], vc.ref[i]));
+        }
+    } else {
+        res.method = "freivalds";
+        res.maxUlp = NAN;
+        vector<long double> x(n), y(n), yAbs(n);
+        for (int trial = 0; trial < VERIFY_FREIVALDS_TRIALS; trial++) {
+            srand(54321 + trial);
+            long double xSum = 0.0L;
+            for (int j = 0; j < n; j++) {
+                x[j] = 2.0L * rand() / RAND_MAX - 1.0L;
+                xSum += fabsl(x[j]);
+            }
+            // y = B x e |B| |x|
+            for (int k = 0; k < n; k++) {
+                long double s = 0.0L, sAbs = 0.0L;
+                const double *b = &vc.B[(size_t)k * n];
+                for (int j = 0; j < n; j++) {
+                    s += b[j] * x[j];
+                    sAbs += fabs(b[j]) * fabsl(x[j]);
+                }
+                y[k] = s;
+                yAbs[k] = sAbs;
+            }
+            // (A y)_i contra (C x)_i; a tolerância é gamma (|A| |B| |x|)_i
+            for (int i = 0; i < n; i++) {
+                long double z = 0.0L, zAbs = 0.0L, w = 0.0L;
+                const double *a = &vc.A[(size_t)i * n];
+                const double *c = C + (size_t)i * n;
+                for (int k = 0; k < n; k++) {
+                    z += a[k] * y[k];
+                    zAbs += fabs(a[k]) * yAbs[k];
+                    w += c[k] * x[k];
+                }
+                double err = (double)fabsl(w - z);
+                verify_accumulate(res, err, normTol >= 0 ? (double)(normTol * xSum) : (double)(gamma * zAbs));
+            }
+        }
+    }
+    free(A);
+    free(B);
+    free(C);
+    return res;
+}
+
+// Tolerância de rel_error das versões de precisão reduzida: arredondamento das duas entradas (2 u) mais a
+// acumulação no tipo de C (K u_acc), com folga 2
+double typed_tolerance(const string &dtype, int n) {
+    double u = dtype_unit_roundoff(dtype);
+    double uAcc = dtype == "double" ? u : ElemTraits<float>::unit_roundoff();
+    return 2.0 * (2.0 * u + n * uAcc);
+}
+
+// Mede o crossover: para cada n (potência de 2) compara o kernel em bloco com um nível de Strassen
+// sobre entradas aleatórias em [-1, 1]; o crossover é o menor n em que o Strassen já ganha
+int MeasureStrassenCrossover(int maxN) {
+    int measured = 0;
+    cout << "\n[Strassen crossover] one recursion level vs blocked kernel (block " << globalBlockSize << ")\n";
+    for (int n = 128; n <= maxN; n *= 2)
+        print_strassen_plan(n, n / 2);
+    cout << setw(8) << "N" << setw(14) << "Block (s)" << setw(14) << "Strassen (s)" << setw(12) << "Ratio" << setw(16) << "Max abs err" << "\n";
+    for (int n = 128; n <= maxN; n *= 2) {
+        Matrix A, B, C;
+        globalArena.views(n, n, n, A, B, C);
+        srand(12345);
+        for (size_t i = 0; i < (size_t)n * n; i++) {
+            A.data[i] = 2.0 * rand() / RAND_MAX - 1.0;
+            B.data[i] = 2.0 * rand() / RAND_MAX - 1.0;
+        }
+        double start_time = omp_get_wtime();
+#pragma omp parallel
+#pragma omp single
+        block_multiply_strided(n, A.data, n, B.data, n, C.data, n, globalBlockSize);
+        double tBlock = omp_get_wtime() - start_time;
+
+        start_time = omp_get_wtime();
+        strassen_gemm(n, n, n, 1.0, A.data, n, B.data, n, 0.0, C.data, n, n / 2, globalBlockSize, strassenTaskDepth);
+        double tStrassen = omp_get_wtime() - start_time;
+        double err = strassen_error(n, A.data, B.data, C.data);
+        cout << setw(8) << n << setw(14) << tBlock << setw(14) << tStrassen << setw(12) << tBlock / tStrassen << setw(16) << err << "\n";
+        if (measured == 0 && tStrassen < tBlock)
+            measured = n;
+    }
+    if (measured > 0)
+        cout << "Measured crossover: N = " << measured << " (leaf size " << measured / 2 << ")\n";
+    else
+        cout << "Strassen did not beat the blocked kernel up to N = " << maxN << "\n";
+    return measured;
+}
+
+// Funções PAPI para métricas e performance evaluation
+
+void handle_error(int retval) {
+    printf("PAPI error %d: %s\n", retval, PAPI_strerror(retval));
+    exit(1);
+}
+
+void init_papi() {
+    int retval = PAPI_library_init(PAPI_VER_CURRENT);
+    if (retval != PAPI_VER_CURRENT && retval < 0) {
+        printf("PAPI library version mismatch!\n");
+        exit(1);
+    }
+    if (retval < 0)
+        handle_error(retval);
+    // Necessário para EventSets por thread (cada thread OpenMP regista-se antes de criar o seu)
+    int threadRet = PAPI_thread_init((unsigned long (*)(void))pthread_self);
+    if (threadRet != PAPI_OK)
+        cout << "WARNING: PAPI_thread_init (" << PAPI_strerror(threadRet) << ")" << endl;
+    cout << "PAPI Version Number: MAJOR: " << PAPI_VERSION_MAJOR(retval)
+         << " MINOR: " << PAPI_VERSION_MINOR(retval)
+         << " REVISION: " << PAPI_VERSION_REVISION(retval) << "\n";
+}
+
+// Contadores PAPI configuráveis
+// A lista de eventos vem de --events (por omissão L1/L2 DCM, ciclos e instruções). Um evento que não
+// exista ou não caiba é avisado e ignorado sozinho, sem desligar os restantes. Se os eventos não
+// couberem nos contadores físicos, o EventSet é recriado em modo multiplexado (valores estimados).
+
+// Valores médios por execução de uma região medida; -1 indica evento indisponível.
+// Com contadores por thread, 'values' é a soma e 'threads[t]' guarda os valores da thread t
+struct CounterSample {
+    vector<string> names;
+    vector<long long> values;
+    vector<vector<long long>> threads;
+
+    long long get(const string &name) const {
+        for (size_t e = 0; e < names.size(); e++)
+            if (names[e] == name)
+                return values[e];
+        return -1;
+    }
+};
+
+class PapiCounters {
+public:
+    vector<string> requested = {"PAPI_L1_DCM", "PAPI_L2_DCM", "PAPI_TOT_CYC", "PAPI_TOT_INS"};
+    bool multiplexed = false;
+
+    PapiCounters() = default;
+    PapiCounters(const PapiCounters &) = delete;
+    PapiCounters &operator=(const PapiCounters &) = delete;
+
+    // Cria o EventSet (ligado à thread que chama) com os eventos pedidos; devolve true se pelo menos um ficou ativo
+    bool open(bool verbose = true) {
+        close();
+        vector<int> conflicts = build(false);
+        if (!conflicts.empty() && PAPI_multiplex_init() == PAPI_OK) {
+            close();
+            build(true);
+        }
+        for (size_t e = 0; verbose && e < requested.size(); e++) {
+            if (!active[e])
+                cout << "WARNING: " << requested[e] << " unavailable (" << PAPI_strerror(status[e]) << "), skipped" << endl;
+        }
+        if (multiplexed && verbose)
+            cout << "PAPI multiplexing enabled for " << activeCount() << " events" << endl;
+        return enabled();
+    }
+
+    void close() {
+        if (eventSet != PAPI_NULL) {
+            PAPI_cleanup_eventset(eventSet);
+            PAPI_destroy_eventset(&eventSet);
+        }
+        eventSet = PAPI_NULL;
+        multiplexed = false;
+        active.clear();
+        status.clear();
+    }
+
+    bool enabled() const { return activeCount() > 0; }
+
+    int activeCount() const { return (int)count(active.begin(), active.end(), true); }
+
+    void start() {
+        if (!enabled()) return;
+        PAPI_reset(eventSet);
+        int ret = PAPI_start(eventSet);
+        if (ret != PAPI_OK) cout << "ERROR: Start PAPI (" << PAPI_strerror(ret) << ")" << endl;
+    }
+
+    // Para os contadores e preenche 'out' com um valor por evento pedido
+    void stop(CounterSample &out) {
+        out.names = requested;
+        out.values.assign(requested.size(), -1);
+        out.threads.clear();
+        if (!enabled()) return;
+        vector<long long> raw(activeCount(), 0);
+        int ret = PAPI_stop(eventSet, raw.data());
+        if (ret != PAPI_OK) {
+            cout << "ERROR: Stop PAPI (" << PAPI_strerror(ret) << ")" << endl;
+            return;
+        }
+        for (size_t e = 0, slot = 0; e < requested.size(); e++)
+            if (active[e])
+                out.values[e] = raw[slot++];
+    }
+
+    ~PapiCounters() { close(); }
+
+private:
+    int eventSet = PAPI_NULL;
+    vector<bool> active;
+    vector<int> status;
+
+    // Devolve os índices dos eventos recusados por falta de contadores
+    vector<int> build(bool multiplex) {
+        vector<int> conflicts;
+        active.assign(requested.size(), false);
+        status.assign(requested.size(), PAPI_OK);
+        int ret = PAPI_create_eventset(&eventSet);
+        if (ret != PAPI_OK) {
+            cout << "ERROR: create eventset (" << PAPI_strerror(ret) << ")" << endl;
+            status.assign(requested.size(), ret);
+            return conflicts;
+        }
+        if (multiplex) {
+            PAPI_assign_eventset_component(eventSet, 0);
+            multiplexed = (PAPI_set_multiplex(eventSet) == PAPI_OK);
+        }
+        for (size_t e = 0; e < requested.size(); e++) {
+            int code = 0;
+            ret = PAPI_event_name_to_code(requested[e].c_str(), &code);
+            if (ret == PAPI_OK)
+                ret = PAPI_add_event(eventSet, code);
+            status[e] = ret;
+            active[e] = (ret == PAPI_OK);
+            if (ret == PAPI_ECNFLCT)
+                conflicts.push_back((int)e);
+        }
+        return conflicts;
+    }
+};
+
+PapiCounters globalCounters;
+
+// Contadores por thread para os kernels OpenMP
+// Cada thread da equipa regista-se no PAPI e arranca o seu próprio EventSet numa região paralela antes
+// da medição; outra região paralela depois da medição para-os. Funciona porque o runtime reutiliza as
+// mesmas threads entre regiões paralelas com o mesmo número de threads (verificado com pthread_self).
+// As threads em espera ativa também contam ciclos: com OMP_WAIT_POLICY=passive o desequilíbrio de
+// carga aparece diretamente na dispersão dos ciclos.
+bool globalPerThreadCounters = true;
+
+class ThreadCounterRegion {
+public:
+    ThreadCounterRegion(CounterSample *sample) : sample(sample) {
+        if (sample && !globalCounters.enabled())
+            globalCounters.stop(*sample);  // apenas marca os eventos como indisponíveis
+        if (!sample || !globalCounters.enabled()) {
+            this->sample = nullptr;
+            return;
+        }
+        int threads = omp_get_max_threads();
+        counters = vector<PapiCounters>(threads);
+        owners.assign(threads, pthread_t());
+        started.assign(threads, 0);
+#pragma omp parallel num_threads(threads)
+        {
+            int t = omp_get_thread_num();
+            PAPI_register_thread();
+            owners[t] = pthread_self();
+            counters[t].requested = globalCounters.requested;
+            started[t] = counters[t].open(false);
+            counters[t].start();
+        }
+    }
+
+    ~ThreadCounterRegion() {
+        if (!sample) return;
+        int threads = (int)counters.size();
+        sample->names = globalCounters.requested;
+        sample->values.assign(sample->names.size(), -1);
+        sample->threads.assign(threads, vector<long long>(sample->names.size(), -1));
+        vector<char> sameThread(threads, 1);
+#pragma omp parallel num_threads(threads)
+        {
+            int t = omp_get_thread_num();
+            if (!pthread_equal(owners[t], pthread_self())) {
+                sameThread[t] = 0;
+            } else if (started[t]) {
+                CounterSample own;
+                counters[t].stop(own);
+                sample->threads[t] = own.values;
+                counters[t].close();
+            }
+            PAPI_unregister_thread();
+        }
+        if (count(sameThread.begin(), sameThread.end(), 0) > 0) {
+            cout << "WARNING: OpenMP thread pool changed during measurement, per-thread counters discarded" << endl;
+            sample->threads.clear();
+            return;
+        }
+        for (size_t e = 0; e < sample->names.size(); e++) {
+            for (int t = 0; t < threads; t++) {
+                long long v = sample->threads[t][e];
+                if (v >= 0)
+                    sample->values[e] = max(0LL, sample->values[e]) + v;
+            }
+        }
+    }
+
+private:
+    CounterSample *sample;
+    vector<PapiCounters> counters;
+    vector<pthread_t> owners;
+    vector<char> started;
+};
+
+// Dispersão de um evento entre threads (sem contadores por thread, count == 0)
+struct ThreadSpread {
+    int count;
+    double min, max, stddev;
+};
+
+ThreadSpread thread_spread(const CounterSample &c, const string &name) {
+    ThreadSpread sp = {0, 0, 0, 0};
+    size_t e = find(c.names.begin(), c.names.end(), name) - c.names.begin();
+    if (e == c.names.size())
+        return sp;
+    vector<double> v;
+    for (const auto &t : c.threads)
+        if (t[e] >= 0)
+            v.push_back((double)t[e]);
+    if (v.empty())
+        return sp;
+    sp.count = (int)v.size();
+    sp.min = *min_element(v.begin(), v.end());
+    sp.max = *max_element(v.begin(), v.end());
+    double mean = 0.0;
+    for (double x : v) mean += x;
+    mean /= v.size();
+    double sq = 0.0;
+    for (double x : v) sq += (x - mean) * (x - mean);
+    sp.stddev = v.size() > 1 ? sqrt(sq / (v.size() - 1)) : 0.0;
+    return sp;
+}
+
+// Região RAII: os contadores correm entre o construtor e o destrutor (sample == nullptr não mede)
+class CounterRegion {
+public:
+    CounterRegion(PapiCounters &counters, CounterSample *sample) : counters(counters), sample(sample) {
+        if (sample) counters.start();
+    }
+    ~CounterRegion() {
+        if (sample) counters.stop(*sample);
+    }
+
+private:
+    PapiCounters &counters;
+    CounterSample *sample;
+};
+
+// Métricas derivadas; NaN quando falta o contador necessário.
+// FLOPs vêm de PAPI_DP_OPS/PAPI_FP_OPS se medidos, senão do valor nominal do algoritmo (2*M*N*K)
+struct DerivedMetrics {
+    double ipc, flopsPerCycle;
+    double l1PerKflop, l2PerKflop, l3PerKflop, tlbPerKflop;
+};
+
+DerivedMetrics derive_metrics(const CounterSample &c, double nominalFlops) {
+    const double nan = NAN;
+    auto ratio = [&](long long num, double den, double scale) { return (num >= 0 && den > 0) ? num * scale / den : nan; };
+    double flops = nominalFlops;
+    if (c.get("PAPI_DP_OPS") > 0) flops = (double)c.get("PAPI_DP_OPS");
+    else if (c.get("PAPI_FP_OPS") > 0) flops = (double)c.get("PAPI_FP_OPS");
+    long long cyc = c.get("PAPI_TOT_CYC");
+    DerivedMetrics d;
+    d.ipc = ratio(c.get("PAPI_TOT_INS"), (double)cyc, 1.0);
+    d.flopsPerCycle = (cyc > 0) ? flops / cyc : nan;
+    d.l1PerKflop = ratio(c.get("PAPI_L1_DCM"), flops, 1000.0);
+    d.l2PerKflop = ratio(c.get("PAPI_L2_DCM"), flops, 1000.0);
+    d.l3PerKflop = ratio(c.get("PAPI_L3_TCM"), flops, 1000.0);
+    d.tlbPerKflop = ratio(c.get("PAPI_TLB_DM"), flops, 1000.0);
+    return d;
+}
+
+void PrintCounters(const CounterSample &c, double nominalFlops) {
+    for (size_t e = 0; e < c.names.size(); e++) {
+        if (c.values[e] < 0)
+            continue;
+        cout << c.names[e] << ": " << c.values[e];
+        ThreadSpread sp = thread_spread(c, c.names[e]);
+        if (sp.count > 1)
+            cout << " (" << sp.count << " threads - min " << (long long)sp.min << " - max " << (long long)sp.max
+                 << " - stddev " << (long long)sp.stddev << ")";
+        cout << endl;
+    }
+    DerivedMetrics d = derive_metrics(c, nominalFlops);
+    if (!std::isnan(d.ipc)) cout << "IPC: " << d.ipc << endl;
+    if (!std::isnan(d.flopsPerCycle)) cout << "FLOPs/cycle: " << d.flopsPerCycle << endl;
+    if (!std::isnan(d.l1PerKflop)) cout << "L1 misses/kFLOP: " << d.l1PerKflop << endl;
+    if (!std::isnan(d.l2PerKflop)) cout << "L2 misses/kFLOP: " << d.l2PerKflop << endl;
+    if (!std::isnan(d.l3PerKflop)) cout << "L3 misses/kFLOP: " << d.l3PerKflop << endl;
+    if (!std::isnan(d.tlbPerKflop)) cout << "TLB misses/kFLOP: " << d.tlbPerKflop << endl;
+}
+
+// Para multiplicação de matrizes NxN consideramos ~2*N^3 operações (N^3 mul + N^3 add)
+// MFlops = (2*N^3) / (tempo * 1e6); nos caminhos esparsos/estruturados usefulOps dá só os flops úteis
+// (2 nnz(A) N, sem produtos por zeros conhecidos nem repetidos)
+// Speedup = (tempo_seq) / (tempo_paralelo)
+// Eficiência = Speedup / (#threads)
+
+struct PerfMetrics {
+    double mflops;
+    double speedup;
+    double efficiency;
+};
+
+PerfMetrics computeMetrics(int N, double timeSerial, double timeParallel, int threads, double usefulOps = 0.0) {
+    PerfMetrics pm;
+    double ops = usefulOps > 0.0 ? usefulOps : 2.0 * (double)N * (double)N * (double)N;
+    pm.mflops = (ops / (timeParallel * 1.0e6));
+    pm.speedup = (timeSerial / timeParallel);
+    pm.efficiency = pm.speedup / (double)threads;
+    return pm;
+}
+
+// Benchmark com aquecimento e repetições
+// As primeiras 'warmup' execuções são descartadas (caches, frequência, page faults); seguem-se 'reps'
+// execuções medidas. Com minTime > 0 repete-se até a soma dos tempos medidos atingir esse orçamento.
+// Outliers pelo critério de Tukey (fora de [Q1 - 1.5 IQR, Q3 + 1.5 IQR]) são contados mas não removidos.
+
+struct BenchConfig {
+    int warmup;
+    int reps;
+    double minTime;
+};
+
+BenchConfig globalBench = {0, 1, 0.0};
+
+struct BenchStats {
+    int reps;
+    double min, median, mean, stddev, ci95;
+    int outliers;
+};
+
+const int BENCH_MAX_REPS = 1000;
+
+// Quantil 0.975 da t de Student para 1..30 graus de liberdade; acima disso usa-se 1.96
+double t_critical_95(int df) {
+    static const double table[30] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                     2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                     2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (df <= 0) return 0.0;
+    return df <= 30 ? table[df - 1] : 1.96;
+}
+
+double quantile_sorted(const vector<double> &sorted, double q) {
+    double pos = q * (sorted.size() - 1);
+    size_t lo = (size_t)pos;
+    size_t hi = min(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (pos - lo) * (sorted[hi] - sorted[lo]);
+}
+
+BenchStats compute_stats(vector<double> times) {
+    BenchStats st = {(int)times.size(), 0, 0, 0, 0, 0, 0};
+    if (times.empty())
+        return st;
+    sort(times.begin(), times.end());
+    st.min = times.front();
+    st.median = quantile_sorted(times, 0.5);
+    double sum = 0.0;
+    for (double t : times) sum += t;
+    st.mean = sum / times.size();
+    if (times.size() > 1) {
+        double sq = 0.0;
+        for (double t : times) sq += (t - st.mean) * (t - st.mean);
+        st.stddev = sqrt(sq / (times.size() - 1));
+        st.ci95 = t_critical_95((int)times.size() - 1) * st.stddev / sqrt((double)times.size());
+        double q1 = quantile_sorted(times, 0.25), q3 = quantile_sorted(times, 0.75);
+        double iqr = q3 - q1;
+        for (double t : times)
+            if (t < q1 - 1.5 * iqr || t > q3 + 1.5 * iqr)
+                st.outliers++;
+    }
+    return st;
+}
+
+// Corre 'run' segundo globalBench; os contadores PAPI cobrem só as execuções medidas
+// e são devolvidos em 'sample' como média por execução. Com 'parallel' (kernels OpenMP)
+// cada thread conta com o seu EventSet e 'sample' recebe a soma e os valores por thread
+BenchStats RunBenchmark(const function<double()> &run, CounterSample *sample = nullptr, bool parallel = false) {
+    for (int w = 0; w < globalBench.warmup; w++)
+        run();
+
+    vector<double> times;
+    double total = 0.0;
+    {
+        bool perThread = parallel && globalPerThreadCounters;
+        CounterRegion region(globalCounters, perThread ? nullptr : sample);
+        ThreadCounterRegion threadRegion(perThread ? sample : nullptr);
+        while ((int)times.size() < max(1, globalBench.reps) ||
+               (total < globalBench.minTime && (int)times.size() < BENCH_MAX_REPS)) {
+            double t = run();
+            times.push_back(t);
+            total += t;
+        }
+    }
+    if (sample) {
+        for (long long &v : sample->values)
+            if (v > 0) v /= (long long)times.size();
+        for (auto &t : sample->threads)
+            for (long long &v : t)
+                if (v > 0) v /= (long long)times.size();
+    }
+
+    BenchStats st = compute_stats(times);
+    if (st.reps > 1) {
+        cout << "  Reps: " << st.reps << " - Min: " << st.min << " s - Median: " << st.median
+             << " s - Mean: " << st.mean << " +/- " << st.ci95 << " s (95% CI) - Stddev: " << st.stddev
+             << " - Outliers: " << st.outliers << endl;
+    }
+    return st;
+}
+
+// Função de teste para medir MFlops, Speedup e Eficiência comparando a versão sequencial e a versão paralela
+void TestParallelPerformance(int N, double (*seqFunc)(int, int), double (*parFunc)(int, int), const string &algName) {
+    int threads = omp_get_max_threads();
+    double tSeq = RunBenchmark([&] { return seqFunc(N, N); }).median;
+    double tPar = RunBenchmark([&] { return parFunc(N, N); }).median;
+    PerfMetrics pm = computeMetrics(N, tSeq, tPar, threads);
+
+    cout << "\n[" << algName << "] N=" << N
+         << " Threads=" << threads << "\n";
+    cout << "  Sequential time = " << tSeq << " s\n";
+    cout << "  Parallel time   = " << tPar << " s\n";
+    cout << "  Speedup          = " << pm.speedup << "\n";
+    cout << "  Efficiency       = " << pm.efficiency << "\n";
+    cout << "  MFlops           = " << pm.mflops << "\n\n";
+}
+
+// Variante para algoritmos em bloco, com o mesmo bkSize na versão sequencial e paralela
+void TestParallelPerformance(int N, int bkSize, double (*seqFunc)(int, int, int), double (*parFunc)(int, int, int), const string &algName) {
+    int threads = omp_get_max_threads();
+    double tSeq = RunBenchmark([&] { return seqFunc(N, N, bkSize); }).median;
+    double tPar = RunBenchmark([&] { return parFunc(N, N, bkSize); }).median;
+    PerfMetrics pm = computeMetrics(N, tSeq, tPar, threads);
+
+    cout << "\n[" << algName << "] N=" << N
+         << " Block=" << bkSize
+         << " Threads=" << threads << "\n";
+    cout << "  Sequential time = " << tSeq << " s\n";
+    cout << "  Parallel time   = " << tPar << " s\n";
+    cout << "  Speedup          = " << pm.speedup << "\n";
+    cout << "  Efficiency       = " << pm.efficiency << "\n";
+    cout << "  MFlops           = " << pm.mflops << "\n\n";
+}
+
+// Linha de resultados partilhada pelo varrimento automático e pelo modo CLI
+struct ResultRow {
+    string algorithm;
+    int size, blockSize, numBlocks;
+    BenchStats stats;
+    CounterSample counters;
+    double speedup, efficiency;
+    int threads, mc, kc, nc;
+    string dtype;
+    double error;  // erro relativo contra double (NaN se não verificado)
+    string verified;     // "pass", "fail" ou vazio sem --verify
+    double verifyRatio;  // maior erro / tolerância
+    int ranks;           // processos MPI (1 fora do modo --mpi)
+    double computeTime, commTime;  // só no modo --mpi: máximo entre processos (NaN nos restantes)
+    double ops;                    // operações por execução para mflops (0 = produto quadrado, 2 * N^3)
+};
+
+const char *RESULT_CSV_HEADER = "algorithm,size,blockSize,numBlocks,time,L1,L2,mflops,speedup,efficiency,threads,mc,kc,nc,numa,"
+                                "reps,min,median,mean,stddev,ci95,outliers,"
+                                "cycles,instructions,fp_ops,L3,TLB,ipc,flops_per_cycle,l1_per_kflop,l2_per_kflop,l3_per_kflop,tlb_per_kflop,"
+                                "counted_threads,cycles_min,cycles_max,cycles_stddev,L1_min,L1_max,L1_stddev,L2_min,L2_max,L2_stddev,dtype,rel_error,verified,verify_ratio,"
+                                "ranks,compute_time,comm_time";
+
+// Contadores e métricas indisponíveis ficam vazios no CSV e null no JSON
+string format_counter(long long v, bool json) {
+    return v >= 0 ? to_string(v) : (json ? "null" : "");
+}
+
+string format_metric(double v, bool json) {
+    if (std::isnan(v))
+        return json ? "null" : "";
+    ostringstream out;
+    out << v;
+    return out.str();
+}
+
+// Cria/trunca o ficheiro de resultados; em JSON cada linha é um objeto (JSON Lines), sem cabeçalho
+void WriteResultHeader(const string &path, bool json) {
+    ofstream outfile(path, ios::out);
+    if (!outfile.is_open()) {
+        cerr << "Error opening file " << path << endl;
+        return;
+    }
+    if (!json)
+        outfile << RESULT_CSV_HEADER << "\n";
+}
+
+// Métricas derivadas de uma linha, calculadas uma vez e formatadas pelos escritores CSV e JSON.
+// 'time' é a mediana das repetições; sem ops explícitas MFlops assume o produto quadrado (2 * N^3)
+struct ResultFields {
+    const ResultRow &row;
+    double ops, mflops;
+    long long fp;
+    DerivedMetrics d;
+    // Desequilíbrio entre threads: min/max/desvio padrão de ciclos e falhas (vazio sem contadores por thread)
+    ThreadSpread spread[3];
+    int countedThreads;
+
+    ResultFields(const ResultRow &r)
+        : row(r), ops(r.ops > 0.0 ? r.ops : 2.0 * (double)r.size * (double)r.size * (double)r.size),
+          mflops(ops / (r.stats.median * 1.0e6)),
+          fp(r.counters.get("PAPI_DP_OPS") >= 0 ? r.counters.get("PAPI_DP_OPS") : r.counters.get("PAPI_FP_OPS")),
+          d(derive_metrics(r.counters, ops)),
+          spread{thread_spread(r.counters, "PAPI_TOT_CYC"), thread_spread(r.counters, "PAPI_L1_DCM"), thread_spread(r.counters, "PAPI_L2_DCM")},
+          countedThreads((int)r.counters.threads.size()) {}
+
+    string counter(const char *event, bool json) const { return format_counter(row.counters.get(event), json); }
+    string spreadValue(int k, double v, bool json) const { return format_counter(spread[k].count > 0 ? llround(v) : -1, json); }
+};
+
+// Campos CSV de uma linha (sem fim de linha), partilhados pelo ficheiro de resultados e pelo histórico
+string result_csv_fields(const ResultRow &row) {
+    ResultFields f(row);
+    const BenchStats &st = row.stats;
+    auto L = [&](const char *event) { return f.counter(event, false); };
+    auto M = [&](double v) { return format_metric(v, false); };
+    ostringstream out;
+    out << row.algorithm << "," << row.size << "," << row.blockSize << "," << row.numBlocks << "," << st.median << "," << L("PAPI_L1_DCM") << "," << L("PAPI_L2_DCM") << "," << f.mflops << "," << M(row.speedup) << "," << M(row.efficiency) << "," << row.threads << "," << row.mc << "," << row.kc << "," << row.nc << "," << numa_policy_name(globalNuma)
+        << "," << st.reps << "," << st.min << "," << st.median << "," << st.mean << "," << st.stddev << "," << st.ci95 << "," << st.outliers
+        << "," << L("PAPI_TOT_CYC") << "," << L("PAPI_TOT_INS") << "," << format_counter(f.fp, false) << "," << L("PAPI_L3_TCM") << "," << L("PAPI_TLB_DM")
+        << "," << M(f.d.ipc) << "," << M(f.d.flopsPerCycle) << "," << M(f.d.l1PerKflop) << "," << M(f.d.l2PerKflop) << "," << M(f.d.l3PerKflop) << "," << M(f.d.tlbPerKflop)
+        << "," << f.countedThreads;
+    for (int k = 0; k < 3; k++)
+        out << "," << f.spreadValue(k, f.spread[k].min, false) << "," << f.spreadValue(k, f.spread[k].max, false) << "," << f.spreadValue(k, f.spread[k].stddev, false);
+    out << "," << row.dtype << "," << M(row.error) << "," << row.verified << "," << M(row.verifyRatio)
+        << "," << row.ranks << "," << M(row.computeTime) << "," << M(row.commTime);
+    return out.str();
+}
+
+// A mesma linha como objeto JSON (uma linha de JSON Lines, sem fim de linha)
+string result_json(const ResultRow &row) {
+    ResultFields f(row);
+    const BenchStats &st = row.stats;
+    auto L = [&](const char *event) { return f.counter(event, true); };
+    auto M = [&](double v) { return format_metric(v, true); };
+    const char *spreadKeys[3] = {"cycles", "L1", "L2"};
+    ostringstream out;
+    out << "{\"algorithm\":\"" << row.algorithm << "\",\"size\":" << row.size << ",\"blockSize\":" << row.blockSize
+        << ",\"numBlocks\":" << row.numBlocks << ",\"time\":" << st.median << ",\"L1\":" << L("PAPI_L1_DCM") << ",\"L2\":" << L("PAPI_L2_DCM")
+        << ",\"mflops\":" << f.mflops << ",\"speedup\":" << M(row.speedup) << ",\"efficiency\":" << M(row.efficiency)
+        << ",\"threads\":" << row.threads << ",\"mc\":" << row.mc << ",\"kc\":" << row.kc << ",\"nc\":" << row.nc
+        << ",\"numa\":\"" << numa_policy_name(globalNuma) << "\",\"reps\":" << st.reps << ",\"min\":" << st.min
+        << ",\"median\":" << st.median << ",\"mean\":" << st.mean << ",\"stddev\":" << st.stddev
+        << ",\"ci95\":" << st.ci95 << ",\"outliers\":" << st.outliers << ",\"cycles\":" << L("PAPI_TOT_CYC")
+        << ",\"instructions\":" << L("PAPI_TOT_INS") << ",\"fp_ops\":" << format_counter(f.fp, true)
+        << ",\"L3\":" << L("PAPI_L3_TCM") << ",\"TLB\":" << L("PAPI_TLB_DM") << ",\"ipc\":" << M(f.d.ipc)
+        << ",\"flops_per_cycle\":" << M(f.d.flopsPerCycle) << ",\"l1_per_kflop\":" << M(f.d.l1PerKflop)
+        << ",\"l2_per_kflop\":" << M(f.d.l2PerKflop) << ",\"l3_per_kflop\":" << M(f.d.l3PerKflop)
+        << ",\"tlb_per_kflop\":" << M(f.d.tlbPerKflop) << ",\"counted_threads\":" << f.countedThreads;
+    for (int k = 0; k < 3; k++)
+        out << ",\"" << spreadKeys[k] << "_min\":" << f.spreadValue(k, f.spread[k].min, true) << ",\"" << spreadKeys[k] << "_max\":"
+            << f.spreadValue(k, f.spread[k].max, true) << ",\"" << spreadKeys[k] << "_stddev\":" << f.spreadValue(k, f.spread[k].stddev, true);
+    out << ",\"dtype\":\"" << row.dtype << "\",\"rel_error\":" << M(row.error) << ",\"verified\":"
+        << (row.verified.empty() ? "null" : "\"" + row.verified + "\"") << ",\"verify_ratio\":" << M(row.verifyRatio)
+        << ",\"ranks\":" << row.ranks << ",\"compute_time\":" << M(row.computeTime) << ",\"comm_time\":" << M(row.commTime) << "}";
+    return out.str();
+}
+
+void AppendHistoryRow(const string &source, const ResultRow &row);
+
+void WriteResultRow(const string &path, const ResultRow &row, bool json) {
+    ofstream outfile(path, ios::out | ios::app);
+    if (!outfile.is_open()) {
+        cerr << "Error opening file " << path << endl;
+        return;
+    }
+    outfile << (json ? result_json(row) : result_csv_fields(row)) << "\n";
+    AppendHistoryRow(path, row);
+}
+
+// Histórico de resultados: cada linha escrita por WriteResultRow é também acrescentada (nunca truncada)
+// a um CSV com os metadados da execução, para comparar execuções e seguir tendências
+struct HistoryConfig {
+    string path;       // "" = histórico desligado
+    string compare;    // "BASE,NEW" para --compare
+    double threshold;  // abrandamento relativo mínimo (%) para contar como regressão
+};
+
+HistoryConfig globalHistory = {"metrics_cpp/history_cpp.csv", "", 5.0};
+
+const char *HISTORY_META_HEADER = "run_id,timestamp,host,cpu,cores,governor,compiler,flags,git_sha,source,";
+
+struct RunInfo {
+    string id, timestamp, host, cpu;
+    int cores;
+    string governor, compiler, flags, gitSha;
+};
+
+// Os campos do histórico são separados por vírgulas sem aspas: vírgulas e quebras de linha passam a espaços
+string history_field(string text) {
+    for (char &ch : text)
+        if (ch == ',' || ch == '\n' || ch == '\r') ch = ' ';
+    size_t b = text.find_first_not_of(' ');
+    size_t e = text.find_last_not_of(' ');
+    return b == string::npos ? string() : text.substr(b, e - b + 1);
+}
+
+vector<string> parse_string_list(const string &text);
+bool parse_rate_list(const string &text, vector<double> &out);
+
+string read_first_line(const string &path) {
+    ifstream in(path);
+    string line;
+    getline(in, line);
+    return line;
+}
+
+// Flags de compilação: -DBUILD_FLAGS="..." na linha de compilação; sem ela, as macros predefinidas que as revelam
+string build_flags() {
+#ifdef BUILD_FLAGS
+    return BUILD_FLAGS;
+#else
+    string flags;
+#ifdef __OPTIMIZE__
+    flags += "optimized";
+#else
+    flags += "-O0";
+#endif
+#ifdef _OPENMP
+    flags += " openmp";
+#endif
+#ifdef __AVX512F__
+    flags += " avx512f";
+#elif defined(__AVX2__)
+    flags += " avx2";
+#elif defined(__AVX__)
+    flags += " avx";
+#endif
+#ifdef __FMA__
+    flags += " fma";
+#endif
+#ifdef __FAST_MATH__
+    flags += " fast-math";
+#endif
+#ifdef USE_MPI
+    flags += " mpi";
+#endif
+    return flags;
+#endif
+}
+
+// Commit: -DGIT_SHA="..." na compilação ou, em alternativa, o HEAD do repositório onde se corre
+string git_sha() {
+#ifdef GIT_SHA
+    return GIT_SHA;
+#else
+    string sha;
+    FILE *pipe = popen("git rev-parse --short HEAD 2>/dev/null", "r");
+    if (pipe) {
+        char buf[64] = {0};
+        if (fgets(buf, sizeof(buf), pipe))
+            sha = buf;
+        pclose(pipe);
+    }
+    sha = history_field(sha);
+    if (sha.empty())
+        return "unknown";
+    FILE *dirty = popen("git status --porcelain --untracked-files=no 2>/dev/null", "r");
+    if (dirty) {
+        char buf[8];
+        if (fgets(buf, sizeof(buf), dirty))
+            sha += "-dirty";
+        pclose(dirty);
+    }
+    return sha;
+#endif
+}
+
+// Metadados recolhidos uma vez por processo; o id junta a hora UTC de arranque, o host e o pid (vários modos
+// lançados no mesmo segundo continuam a ser execuções distintas)
+const RunInfo &current_run() {
+    static RunInfo info = [] {
+        RunInfo r;
+        time_t now = time(nullptr);
+        struct tm utc;
+        gmtime_r(&now, &utc);
+        char stamp[32], id[32];
+        strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", &utc);
+        strftime(id, sizeof(id), "%Y%m%d-%H%M%S", &utc);
+        r.host = history_field(host_name());
+        r.id = string(id) + "-" + r.host + "-" + to_string(getpid());
+        r.timestamp = stamp;
+        r.cpu = history_field(cpu_model());
+        r.cores = (int)thread::hardware_concurrency();
+        r.governor = history_field(read_first_line("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor"));
+        if (r.governor.empty()) r.governor = "unknown";
+#ifdef __VERSION__
+        r.compiler = history_field(__VERSION__);
+#else
+        r.compiler = "unknown";
+#endif
+        r.flags = history_field(build_flags());
+        r.gitSha = git_sha();
+        return r;
+    }();
+    return info;
+}
+
+// 'source' é o ficheiro de resultados de origem; o histórico fica sempre em CSV, mesmo com --format json
+void AppendHistoryRow(const string &source, const ResultRow &row) {
+    if (globalHistory.path.empty() || source == globalHistory.path)
+        return;
+    bool fresh = read_first_line(globalHistory.path).empty();
+    ofstream out(globalHistory.path, ios::out | ios::app);
+    if (!out.is_open()) {
+        cerr << "Error opening file " << globalHistory.path << endl;
+        return;
+    }
+    if (fresh)
+        out << HISTORY_META_HEADER << RESULT_CSV_HEADER << "\n";
+    const RunInfo &r = current_run();
+    string name = source.substr(source.find_last_of('/') + 1);
+    name = name.substr(0, name.find('.'));
+    out << r.id << "," << r.timestamp << "," << r.host << "," << r.cpu << "," << r.cores << "," << r.governor << ","
+        << r.compiler << "," << r.flags << "," << r.gitSha << "," << history_field(name) << "," << result_csv_fields(row) << "\n";
+}
+
+struct HistoryRecord {
+    map<string, string> meta;  // run_id, host, cpu, ... de HISTORY_META_HEADER
+    map<string, double> value;  // median, stddev, reps, ...
+    string key;                // fonte/algoritmo/N/bloco/numBlocks/threads/dtype/ranks
+};
+
+vector<HistoryRecord> load_history(const string &path) {
+    vector<HistoryRecord> records;
+    ifstream in(path);
+    string line;
+    if (!getline(in, line))
+        return records;
+    vector<string> header = parse_string_list(line);
+    while (getline(in, line)) {
+        vector<string> fields;
+        size_t pos = 0;
+        while (true) {
+            size_t end = line.find(',', pos);
+            fields.push_back(line.substr(pos, end == string::npos ? string::npos : end - pos));
+            if (end == string::npos) break;
+            pos = end + 1;
+        }
+        if (fields.size() != header.size())
+            continue;
+        HistoryRecord rec;
+        for (size_t k = 0; k < header.size(); k++) {
+            rec.meta[header[k]] = fields[k];
+            rec.value[header[k]] = fields[k].empty() ? NAN : atof(fields[k].c_str());
+        }
+        rec.key = rec.meta["source"] + "/" + rec.meta["algorithm"] + "/" + rec.meta["size"] + "/" + rec.meta["blockSize"] + "/" +
+                  rec.meta["numBlocks"] + "/" + rec.meta["threads"] + "/" + rec.meta["dtype"] + "/" + rec.meta["ranks"];
+        records.push_back(rec);
+    }
+    return records;
+}
+
+// "latest" e "previous" são a última e a penúltima execução do histórico e um run_id é essa execução; senão
+// é o prefixo de um commit e conta cada execução com esse git_sha (um commit costuma ter uma por modo:
+// testes automáticos, varrimento, lote, ...). Nas chaves repetidas vale a linha mais recente
+vector<string> resolve_runs(const vector<HistoryRecord> &records, const string &spec) {
+    vector<string> runs;
+    for (const HistoryRecord &rec : records) {
+        const string &id = rec.meta.at("run_id");
+        if (runs.empty() || runs.back() != id) {
+            runs.erase(remove(runs.begin(), runs.end(), id), runs.end());
+            runs.push_back(id);
+        }
+    }
+    if (spec == "latest") return runs.empty() ? vector<string>() : vector<string>{runs.back()};
+    if (spec == "previous") return runs.size() < 2 ? vector<string>() : vector<string>{runs[runs.size() - 2]};
+    if (find(runs.begin(), runs.end(), spec) != runs.end()) return {spec};
+    vector<string> matched;
+    for (const HistoryRecord &rec : records) {
+        const string &id = rec.meta.at("run_id");
+        if (rec.meta.at("git_sha").compare(0, spec.size(), spec) == 0 && find(matched.begin(), matched.end(), id) == matched.end())
+            matched.push_back(id);
+    }
+    return matched;
+}
+
+// Compara duas execuções por kernel/N/bloco/threads/dtype. Há regressão quando a mediana abranda mais do que
+// o limiar E a diferença é significativa num teste t de Welch a 95% (desvio padrão e repetições de cada linha).
+// Linhas com uma só repetição não têm variância: são "inconclusive" e não contam. Devolve 1 se houver regressões
+int RunCompare(const string &spec) {
+    vector<string> ids = parse_string_list(spec);
+    if (ids.size() != 2) {
+        cerr << "--compare needs BASE,NEW (run ids, git SHA prefixes, latest or previous)" << endl;
+        return 1;
+    }
+    vector<HistoryRecord> records = load_history(globalHistory.path);
+    if (records.empty()) {
+        cerr << "No history in " << globalHistory.path << endl;
+        return 1;
+    }
+    vector<string> base = resolve_runs(records, ids[0]), next = resolve_runs(records, ids[1]);
+    if (base.empty() || next.empty()) {
+        cerr << "Unknown run: " << (base.empty() ? ids[0] : ids[1]) << endl;
+        return 1;
+    }
+
+    map<string, const HistoryRecord *> baseRows, nextRows;
+    vector<string> order;
+    auto in = [](const vector<string> &runs, const string &id) { return find(runs.begin(), runs.end(), id) != runs.end(); };
+    for (const HistoryRecord &rec : records) {
+        const string &id = rec.meta.at("run_id");
+        if (in(base, id)) baseRows[rec.key] = &rec;
+        if (in(next, id)) {
+            if (!nextRows.count(rec.key)) order.push_back(rec.key);
+            nextRows[rec.key] = &rec;
+        }
+    }
+
+    const HistoryRecord &b0 = *baseRows.begin()->second, &n0 = *nextRows.begin()->second;
+    auto describe = [](const vector<string> &runs, const HistoryRecord &rec) {
+        return (runs.size() == 1 ? runs[0] : to_string(runs.size()) + " runs") + " (" + rec.meta.at("git_sha") + ")";
+    };
+    cout << "Base: " << describe(base, b0) << "\nNew:  " << describe(next, n0) << endl;
+    for (const char *field : {"host", "cpu", "cores", "governor", "compiler", "flags"})
+        if (b0.meta.at(field) != n0.meta.at(field))
+            cout << "Warning: " << field << " differs (" << b0.meta.at(field) << " -> " << n0.meta.at(field) << ")" << endl;
+
+    cout << left << setw(44) << "Kernel" << right << setw(13) << "Base (s)" << setw(13) << "New (s)" << setw(10) << "Change"
+         << setw(9) << "t" << "  Status" << endl;
+    int regressions = 0, improvements = 0, inconclusive = 0, compared = 0;
+    for (const string &key : order) {
+        auto it = baseRows.find(key);
+        if (it == baseRows.end())
+            continue;
+        const map<string, double> &bv = it->second->value, &nv = nextRows[key]->value;
+        double m1 = bv.at("median"), m2 = nv.at("median");
+        double n1 = bv.at("reps"), n2 = nv.at("reps");
+        if (!(m1 > 0.0) || !(m2 > 0.0))
+            continue;
+        compared++;
+        double change = (m2 - m1) / m1 * 100.0;
+        string status = "same";
+        double t = NAN;
+        if (n1 < 2 || n2 < 2) {
+            if (fabs(change) > globalHistory.threshold) {
+                status = "inconclusive";
+                inconclusive++;
+            }
+        } else {
+            double v1 = bv.at("stddev") * bv.at("stddev") / n1, v2 = nv.at("stddev") * nv.at("stddev") / n2;
+            double se = sqrt(v1 + v2);
+            // Graus de liberdade de Welch-Satterthwaite
+            double df = se > 0.0 ? (v1 + v2) * (v1 + v2) / (v1 * v1 / (n1 - 1) + v2 * v2 / (n2 - 1)) : n1 + n2 - 2;
+            t = se > 0.0 ? (m2 - m1) / se : (m2 == m1 ? 0.0 : copysign(INFINITY, m2 - m1));
+            bool significant = fabs(t) > t_critical_95(max(1, (int)df));
+            if (significant && change > globalHistory.threshold) {
+                status = "REGRESSION";
+                regressions++;
+            } else if (significant && change < -globalHistory.threshold) {
+                status = "faster";
+                improvements++;
+            }
+        }
+        const map<string, string> &meta = nextRows[key]->meta;
+        string label = meta.at("algorithm") + " N=" + meta.at("size");
+        if (meta.at("blockSize") != "0") label += " b=" + meta.at("blockSize");
+        label += " t=" + meta.at("threads");
+        if (meta.at("dtype") != "double") label += " " + meta.at("dtype");
+        if (meta.at("ranks") != "1") label += " r=" + meta.at("ranks");
+        ostringstream tText;
+        if (std::isnan(t)) tText << "-";
+        else tText << fixed << setprecision(2) << t;
+        cout << left << setw(44) << label << right << setw(13) << m1 << setw(13) << m2 << setw(9) << fixed << setprecision(1)
+             << change << "%" << defaultfloat << setprecision(6) << setw(9) << tText.str() << "  " << status << endl;
+    }
+    cout << compared << " kernels compared (threshold " << globalHistory.threshold << "%): " << regressions << " regressions, "
+         << improvements << " improvements, " << inconclusive << " inconclusive" << endl;
+    if (inconclusive > 0)
+        cout << "Inconclusive rows have a single repetition on one side; record both runs with --reps 5 or more" << endl;
+    return regressions > 0 ? 1 : 0;
+}
+
+double RunAutomatedTests() {
+    CounterSample sample;
+    int threads = omp_get_max_threads();
+    
+    const string path = "metrics_cpp/results_cpp.csv";
+    WriteResultHeader(path, false);
+
+    vector<int> sizes1;
+    for (int n = 600; n <= 3000; n += 400) {
+        sizes1.push_back(n);
+    }
+    vector<int> sizes2;
+    for (int n = 4096; n <= 10240; n += 2048) {
+        sizes2.push_back(n);
+    }
+    vector<int> blockSizes = {128, 256, 512};
+
+    // Uma única reserva para o maior N do varrimento; todos os kernels reutilizam a arena
+    int maxN = max(*max_element(sizes1.begin(), sizes1.end()), *max_element(sizes2.begin(), sizes2.end()));
+    globalArena.reserve((size_t)maxN * maxN);
+    
+    // Os contadores são médias por execução da última medição com contadores
+    auto WriteResult = [&](const string &algorithm, int size, int blockSize, int numBlocks, const BenchStats &st, double speedup = 1.0, double efficiency = 1.0, int mc = 0, int kc = 0, int nc = 0) {
+        ResultRow row = {algorithm, size, blockSize, numBlocks, st, sample, speedup, efficiency, threads, mc, kc, nc, "double", NAN, "", NAN, 1, NAN, NAN, 0.0};
+        WriteResultRow(path, row, false);
+    };
+
+    auto Measure = [&](const function<double()> &run, bool parallel = false) {
+        return RunBenchmark(run, &sample, parallel);
+    };
+    
+    for (int n : sizes1) {
+        // Standard
+        WriteResult("Standard", n, 0, 0, Measure([&] { return OnMult(n, n); }));
+    }
+
+    for (int n : sizes1) {
+        WriteResult("Line", n, 0, 0, Measure([&] { return OnMultLine(n, n); }));
+    }
+
+    for (int n : sizes2) {
+        WriteResult("Line_large", n, 0, 0, Measure([&] { return OnMultLine(n, n); }));
+    }
+
+    for (int n : sizes2) {
+        for (int bs : blockSizes) {
+            int n_i = (n + bs - 1) / bs;
+            int n_k = (n + bs - 1) / bs;
+            int n_j = (n + bs - 1) / bs;
+            int totalBlocks = n_i * n_k * n_j;
+            WriteResult("Block_" + to_string(bs), n, bs, totalBlocks, Measure([&] { return OnMultBlock(n, n, bs); }));
+        }
+    }
+
+    for (int n : sizes1) {
+        WriteResult("Simd", n, 0, 0, Measure([&] { return OnMultSimd(n, n); }), 1.0, 1.0, SIMD_MC, SIMD_KC, SIMD_NC);
+    }
+
+    for (int n : sizes2) {
+        WriteResult("Simd_large", n, 0, 0, Measure([&] { return OnMultSimd(n, n); }), 1.0, 1.0, SIMD_MC, SIMD_KC, SIMD_NC);
+    }
+
+    for (int n : sizes2) {
+        // KC percorre os mesmos valores de blockSizes; MC e NC vêm da configuração global
+        for (int kc : blockSizes) {
+            int totalBlocks = ((n + globalMC - 1) / globalMC) * ((n + kc - 1) / kc) * ((n + globalNC - 1) / globalNC);
+            BenchStats st = Measure([&] { return OnMultBlockPacked(n, n, globalMC, kc, globalNC); });
+            WriteResult("BlockPacked_" + to_string(kc), n, 0, totalBlocks, st, 1.0, 1.0, globalMC, kc, globalNC);
+        }
+    }
+
+    // Versões paralelas: a referência sequencial é medida sem contadores, os contadores ficam com a paralela
+    for (int n : sizes1) {
+        // External Parallel Line
+        double tSeq = RunBenchmark([&] { return OnMultLine(n, n); }).median;
+        BenchStats par = Measure([&] { return OnMultLineExtParallel(n, n); }, true);
+        double speedup = tSeq / par.median;
+        WriteResult("LineExtParallel", n, 0, 0, par, speedup, speedup / threads);
+    }
+
+    for (int n : sizes2) {
+        // External Parallel Line
+        double tSeq = RunBenchmark([&] { return OnMultLine(n, n); }).median;
+        BenchStats par = Measure([&] { return OnMultLineExtParallel(n, n); }, true);
+        double speedup = tSeq / par.median;
+        WriteResult("LineExtParallel_large", n, 0, 0, par, speedup, speedup / threads);
+    }
+
+    for (int n : sizes1) {
+        // Internal Parallel Line
+        double tSeq = RunBenchmark([&] { return OnMultLine(n, n); }).median;
+        BenchStats par = Measure([&] { return OnMultLineIntParallel(n, n); }, true);
+        double speedup = tSeq / par.median;
+        WriteResult("LineIntParallel", n, 0, 0, par, speedup, speedup / threads);
+    }
+
+    for (int n : sizes2) {
+        // Internal Parallel Line
+        double tSeq = RunBenchmark([&] { return OnMultLine(n, n); }).median;
+        BenchStats par = Measure([&] { return OnMultLineIntParallel(n, n); }, true);
+        double speedup = tSeq / par.median;
+        WriteResult("LineIntParallel_large", n, 0, 0, par, speedup, speedup / threads);
+    }
+
+    for (int n : sizes2) {
+        // Strassen: numBlocks guarda o número de produtos nas folhas (7^níveis)
+        int levels, leaf;
+        strassen_plan(n, strassenCrossover, levels, leaf);
+        print_strassen_plan(n, strassenCrossover);
+        WriteResult("Strassen_large", n, 0, (int)pow(7.0, levels), Measure([&] { return OnMultStrassen(n, n, strassenCrossover); }, true));
+    }
+
+    for (int n : sizes2) {
+        // Morton: blockSize guarda a tile do caso base e numBlocks o número de produtos de tiles (8^níveis)
+        int levels, leaf;
+        strassen_plan(n, MORTON_LEAF, levels, leaf);
+        WriteResult("Morton_large", n, leaf, 1 << (3 * levels), Measure([&] { return OnMultMorton(n, n); }, true));
+    }
+
+    for (int n : sizes2) {
+        // Block Parallel (tasks), com OnMultBlock do mesmo bloco como referência sequencial
+        for (int bs : blockSizes) {
+            int n_i = (n + bs - 1) / bs;
+            int totalBlocks = n_i * n_i * n_i;
+            double tSeq = RunBenchmark([&] { return OnMultBlock(n, n, bs); }).median;
+            BenchStats par = Measure([&] { return OnMultBlockParallel(n, n, bs); }, true);
+            double speedup = tSeq / par.median;
+            WriteResult("BlockParallel_" + to_string(bs), n, bs, totalBlocks, par, speedup, speedup / threads);
+        }
+    }
+
+    return 0;
+}
+
+// Modo não interativo: varrimento configurado por argumentos ou por ficheiro de configuração
+// Cada opção --chave valor também pode ser escrita como "chave = valor" num ficheiro passado com --config
+// (linhas começadas por # são comentários). Exemplo:
+//   ./lab1 --algos Line,Simd,BlockParallel --sizes 1024:4096:1024 --blocks 128,256 --threads 1,8 --reps 5 --format json
+
+struct SweepConfig {
+    bool enabled;
+    vector<string> algorithms;
+    vector<int> sizes;
+    vector<int> blockSizes;
+    vector<int> threads;
+    string output;
+    bool json;
+    string scaling;  // "", "strong", "weak" ou "both"
+    string roofline;  // "", "probes" (só tetos) ou "full" (tetos e kernels)
+    vector<string> dtypes;
+    string verify;  // "", "on" (coluna verified no varrimento) ou "all" (só verificação)
+    bool autotune;
+};
+
+SweepConfig globalSweep = {false, {}, {}, {128, 256, 512}, {}, "", false, "", "", {"double"}, "", false};
+
+// Modo fora do núcleo (ver RunOutOfCore)
+struct OocConfig {
+    int n;         // 0 = modo desligado
+    int tile;
+    bool useMmap;  // leitura das tiles por memcpy de um mapeamento em vez de pread
+    string dir;
+};
+
+OocConfig globalOoc = {0, 2048, false, "ooc_data"};
+
+// Operandos de ficheiros .cpdm (ver RunFileInputs)
+struct FileInputConfig {
+    string a, b, c;             // c vazio: C não é escrito
+    vector<string> make;        // ficheiros a gerar antes de correr
+};
+
+FileInputConfig globalFiles;
+
+// Multiplicação distribuída (ver RunSumma; só com -DUSE_MPI)
+struct MpiConfig {
+    string algo;  // "" = modo desligado, "summa"
+    int panel;    // largura dos painéis difundidos
+};
+
+MpiConfig globalMpi = {"", 256};
+
+int globalBatchCount = 0;  // produtos por lote no benchmark do lote (0 = modo desligado)
+
+vector<double> globalSparseDensities;  // densidades de RunStructured (vazio = modo desligado)
+vector<string> globalEpilogues;  // epílogos de RunEpilogueBenchmark (vazio = modo desligado)
+
+// Gerador de carga do serviço GEMM (ver RunServiceLoad)
+struct ServiceConfig {
+    vector<double> rates;  // vazio = modo desligado
+    int workers;           // 0 = thread::hardware_concurrency()
+    int maxBatch;
+    int requests;          // por taxa
+};
+
+ServiceConfig globalService = {{}, 0, 32, 20000};
+
+struct AlgoEntry {
+    string name;
+    bool usesBlock;
+    string baseline;  // algoritmo sequencial usado para o speedup ("" se o próprio é sequencial)
+    function<double(int, int)> run;  // (n, bkSize)
+};
+
+vector<AlgoEntry> algorithm_registry() {
+    return {
+        {"Standard", false, "", [](int n, int) { return OnMult(n, n); }},
+        {"Line", false, "", [](int n, int) { return OnMultLine(n, n); }},
+        {"Block", true, "", [](int n, int bs) { return OnMultBlock(n, n, bs); }},
+        {"LineExtParallel", false, "Line", [](int n, int) { return OnMultLineExtParallel(n, n); }},
+        {"LineIntParallel", false, "Line", [](int n, int) { return OnMultLineIntParallel(n, n); }},
+        {"BlockParallel", true, "Block", [](int n, int bs) { return OnMultBlockParallel(n, n, bs); }},
+        {"Simd", false, "", [](int n, int) { return OnMultSimd(n, n); }},
+        {"BlockPacked", true, "", [](int n, int bs) { return OnMultBlockPacked(n, n, globalMC, bs > 0 ? bs : globalKC, globalNC); }},
+        {"Strassen", false, "", [](int n, int) { return OnMultStrassen(n, n, strassenCrossover); }},
+        {"Morton", false, "", [](int n, int) { return OnMultMorton(n, n); }},
+    };
+}
+
+// Opções de gemm equivalentes a uma entrada do registo (BlockPacked é o motor SIMD com KC = bloco)
+GemmOptions registry_gemm_options(const string &name, int bs) {
+    GemmAlgo algo = GEMM_SIMD;
+    gemm_algo_from_name(name, algo);
+    GemmOptions opt(algo, bs);
+    if (name == "BlockPacked") {
+        opt.mc = globalMC;
+        opt.kc = bs > 0 ? bs : globalKC;
+        opt.nc = globalNC;
+    }
+    return opt;
+}
+
+// "600,1000,1400" ou "600:3000:400" (início:fim:passo)
+vector<int> parse_int_list(const string &text) {
+    vector<int> out;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find(',', pos);
+        if (end == string::npos) end = text.size();
+        string item = text.substr(pos, end - pos);
+        size_t c1 = item.find(':');
+        if (c1 != string::npos) {
+            size_t c2 = item.find(':', c1 + 1);
+            int lo = atoi(item.c_str());
+            int hi = atoi(item.c_str() + c1 + 1);
+            int step = (c2 != string::npos) ? atoi(item.c_str() + c2 + 1) : 1;
+            for (int v = lo; step > 0 && v <= hi; v += step)
+                out.push_back(v);
+        } else if (!item.empty()) {
+            out.push_back(atoi(item.c_str()));
+        }
+        pos = end + 1;
+    }
+    return out;
+}
+
+vector<string> parse_string_list(const string &text) {
+    vector<string> out;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find(',', pos);
+        if (end == string::npos) end = text.size();
+        if (end > pos)
+            out.push_back(text.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    return out;
+}
+
+// Taxas de chegada (pedidos/s): têm de ser números positivos, senão o intervalo entre chegadas não é finito
+bool parse_rate_list(const string &text, vector<double> &out) {
+    out.clear();
+    for (const string &item : parse_string_list(text)) {
+        char *end = nullptr;
+        double rate = strtod(item.c_str(), &end);
+        if (end == item.c_str() || *end != '\0' || !(rate > 0.0) || !isfinite(rate)) {
+            cerr << "Invalid arrival rate: " << item << endl;
+            return false;
+        }
+        out.push_back(rate);
+    }
+    return true;
+}
+
+void PrintUsage(const char *prog) {
+    cout << "Usage: " << prog << " [options]   (no sweep options: interactive menu)\n"
+         << "  --algos LIST       Standard,Line,Block,LineExtParallel,LineIntParallel,BlockParallel,Simd,BlockPacked,Strassen,Morton\n"
+         << "  --sizes LIST       e.g. 600,1000 or 600:3000:400\n"
+         << "  --blocks LIST      block sizes for Block/BlockParallel, KC for BlockPacked (default 128,256,512)\n"
+         << "  --threads LIST     OpenMP thread counts (default: omp_get_max_threads())\n"
+         << "  --dtypes LIST      double,float,bf16,fp16 (bf16/fp16 stored, fp32 accumulated; default double)\n"
+         << "  --warmup N         discarded runs before measuring\n"
+         << "  --reps N           measured repetitions\n"
+         << "  --min-time S       repeat until S seconds of measured time\n"
+         << "  --output PATH      result file (default metrics_cpp/sweep_cpp.csv or .jsonl)\n"
+         << "  --format csv|json  CSV or JSON Lines\n"
+         << "  --config FILE      read the same options as 'key = value' lines\n"
+         << "  --events LIST      PAPI events, e.g. PAPI_TOT_CYC,PAPI_TOT_INS,PAPI_DP_OPS,PAPI_L3_TCM,PAPI_TLB_DM\n"
+         << "                     (default PAPI_L1_DCM,PAPI_L2_DCM,PAPI_TOT_CYC,PAPI_TOT_INS; multiplexed if needed)\n"
+         << "  --per-thread on|off  one EventSet per OpenMP thread for parallel kernels (default on)\n"
+         << "  --scaling MODE     strong|weak|both thread-scaling study of the parallel algorithms\n"
+         << "                     (base N = first --sizes entry, default 1024; --threads overrides 1..P)\n"
+         << "  --roofline MODE    probes (bandwidth/FMA ceilings) or full (ceilings + kernels at first --sizes entry)\n"
+         << "  --ooc N            out-of-core multiplication of N x N operands stored as tiled files\n"
+         << "  --ooc-tile T       tile size in elements per side (default 2048; I/O volume scales with 1/T)\n"
+         << "  --ooc-io MODE      pread (default) or mmap reads, prefetched one tile pair ahead\n"
+         << "  --ooc-dir DIR      directory for the tiled A/B/C files (default ooc_data); kernel = first --algos entry\n"
+         << "  --input-a FILE     run --algos (default Simd; Auto = structure-aware dispatch) on C = A * B read from .cpdm files\n"
+         << "  --input-b FILE     (double row/col-major mapped without copy, other dtypes/tiled converted)\n"
+         << "  --output-c FILE    write C as a double row-major .cpdm file\n"
+         << "  --make-matrix SPEC FILE:ROWSxCOLS[:random|ones|subnormal|sparse|lower[:row|col|tiled[:dtype]]] (repeatable)\n"
+         << "  --autotune on      tune block dims/threads/schedule of Block, BlockParallel, LineExt/IntParallel (or --algos)\n"
+         << "                     at --sizes (default 512,1024) and save the host profile\n"
+         << "  --profile PATH|off tuning profile (default profiles/<host>.profile); block size 0 in --blocks uses it\n"
+         << "  --batch COUNT      batched small GEMM: COUNT independent N x N products per --sizes entry (default\n"
+         << "                     4,8,16,32,64,128), per-call gemm() vs batch API, matrices/s to metrics_cpp/batch_cpp.csv\n"
+         << "  --epilogue LIST    fused epilogues (scale,bias_relu,bias_gelu,clamp,relu_float,relu_bf16,relu_fp16 or all)\n"
+         << "                     applied per C row/tile vs a second pass, for --algos (default Line,Block,BlockParallel)\n"
+         << "                     at --sizes (default 1024,2048); throughput to metrics_cpp/epilogue_cpp.csv\n"
+         << "  --sparse DENSITIES sparse (CSR/BCSR SpMM), triangular (TRMM), symmetric (SYMM/SYRK) and auto-dispatched\n"
+         << "                     paths vs dense at --sizes (default 1024); useful MFlops to metrics_cpp/structured_cpp.csv\n"
+         << "  --service RATES    GEMM service under open-loop Poisson load at each rate (requests/s), sizes drawn from\n"
+         << "                     --sizes (default 8,16,32,64,128); p50/p99/p999 latency to metrics_cpp/service_cpp.csv\n"
+         << "  --service-workers W  worker threads (default: hardware threads)\n"
+         << "  --service-batch B  most small requests run by one worker wake-up (default 32)\n"
+         << "  --service-requests R  requests per rate (default 20000)\n"
+         << "  --mpi summa        distributed C = A * B on a 2D grid of MPI ranks (build with mpicxx -DUSE_MPI, run under\n"
+         << "                     mpirun -np k); --sizes, local kernel = first --algos entry (default Block)\n"
+         << "  --mpi-panel NB     width of the broadcast A/B panels (default 256)\n"
+         << "  --history PATH|off append-only store of every result row with run metadata (host, CPU, cores, governor,\n"
+         << "                     compiler, flags, git SHA; default metrics_cpp/history_cpp.csv)\n"
+         << "  --compare BASE,NEW diff two recorded runs (run id, latest, previous, or a git SHA prefix = all runs of that\n"
+         << "                     commit) per kernel/size; Welch t-test at 95% plus --regress-threshold, exit 1 on any\n"
+         << "                     regression\n"
+         << "  --regress-threshold PCT  smallest median slowdown counted as a regression (default 5)\n"
+         << "  --verify MODE      on: check every sweep row on random inputs (verified column);\n"
+         << "                     all: verify --algos (default all) at --sizes on random/adversarial inputs, exit 1 on failure\n";
+}
+
+bool apply_option(const string &key, const string &value);
+
+bool load_config(const string &path) {
+    ifstream in(path);
+    if (!in.is_open()) {
+        cerr << "Error opening config " << path << endl;
+        return false;
+    }
+    string line;
+    bool ok = true;
+    while (getline(in, line)) {
+        size_t hash = line.find('#');
+        if (hash != string::npos) line = line.substr(0, hash);
+        size_t eq = line.find('=');
+        if (eq == string::npos) continue;
+        auto trim = [](string x) {
+            size_t b = x.find_first_not_of(" \t\r");
+            size_t e = x.find_last_not_of(" \t\r");
+            return b == string::npos ? string() : x.substr(b, e - b + 1);
+        };
+        ok = apply_option(trim(line.substr(0, eq)), trim(line.substr(eq + 1))) && ok;
+    }
+    return ok;
+}
+
+bool apply_option(const string &key, const string &value) {
+    if (key == "warmup") globalBench.warmup = max(0, atoi(value.c_str()));
+    else if (key == "reps") globalBench.reps = max(1, atoi(value.c_str()));
+    else if (key == "min-time") globalBench.minTime = atof(value.c_str());
+    else if (key == "algos") { globalSweep.algorithms = parse_string_list(value); globalSweep.enabled = true; }
+    else if (key == "sizes") { globalSweep.sizes = parse_int_list(value); globalSweep.enabled = true; }
+    else if (key == "blocks") globalSweep.blockSizes = parse_int_list(value);
+    else if (key == "dtypes") {
+        globalSweep.dtypes = parse_string_list(value);
+        for (const string &dtype : globalSweep.dtypes) {
+            if (find(DTYPES.begin(), DTYPES.end(), dtype) == DTYPES.end()) {
+                cerr << "Unknown dtype: " << dtype << endl;
+                return false;
+            }
+        }
+    }
+    else if (key == "threads") globalSweep.threads = parse_int_list(value);
+    else if (key == "output") globalSweep.output = value;
+    else if (key == "format") globalSweep.json = (value == "json");
+    else if (key == "config") return load_config(value);
+    else if (key == "events") globalCounters.requested = parse_string_list(value);
+    else if (key == "per-thread") globalPerThreadCounters = (value != "off");
+    else if (key == "scaling") {
+        if (value != "strong" && value != "weak" && value != "both") {
+            cerr << "Unknown scaling mode: " << value << endl;
+            return false;
+        }
+        globalSweep.scaling = value;
+    }
+    else if (key == "roofline") {
+        if (value != "probes" && value != "full") {
+            cerr << "Unknown roofline mode: " << value << endl;
+            return false;
+        }
+        globalSweep.roofline = value;
+    }
+    else if (key == "profile") globalProfile.path = value;
+    else if (key == "autotune") globalSweep.autotune = (value == "on");
+    else if (key == "input-a") globalFiles.a = value;
+    else if (key == "input-b") globalFiles.b = value;
+    else if (key == "output-c") globalFiles.c = value;
+    else if (key == "make-matrix") globalFiles.make.push_back(value);
+    else if (key == "mpi") {
+        if (value != "summa") {
+            cerr << "Unknown MPI algorithm: " << value << endl;
+            return false;
+        }
+        globalMpi.algo = value;
+    }
+    else if (key == "sparse") {
+        globalSparseDensities.clear();
+        for (const string &d : parse_string_list(value))
+            globalSparseDensities.push_back(atof(d.c_str()));
+    }
+    else if (key == "service") {
+        if (!parse_rate_list(value, globalService.rates))
+            return false;
+    }
+    else if (key == "service-workers") globalService.workers = atoi(value.c_str());
+    else if (key == "service-batch") globalService.maxBatch = max(1, atoi(value.c_str()));
+    else if (key == "service-requests") globalService.requests = max(1, atoi(value.c_str()));
+    else if (key == "epilogue") globalEpilogues = parse_string_list(value);
+    else if (key == "batch") globalBatchCount = max(1, atoi(value.c_str()));
+    else if (key == "history") globalHistory.path = (value == "off") ? "" : value;
+    else if (key == "compare") globalHistory.compare = value;
+    else if (key == "regress-threshold") globalHistory.threshold = max(0.0, atof(value.c_str()));
+    else if (key == "mpi-panel") globalMpi.panel = max(1, atoi(value.c_str()));
+    else if (key == "ooc") globalOoc.n = atoi(value.c_str());
+    else if (key == "ooc-tile") globalOoc.tile = atoi(value.c_str());
+    else if (key == "ooc-dir") globalOoc.dir = value;
+    else if (key == "ooc-io") {
+        if (value != "pread" && value != "mmap") {
+            cerr << "Unknown out-of-core I/O mode: " << value << endl;
+            return false;
+        }
+        globalOoc.useMmap = (value == "mmap");
+    }
+    else if (key == "verify") {
+        if (value != "on" && value != "off" && value != "all") {
+            cerr << "Unknown verify mode: " << value << endl;
+            return false;
+        }
+        globalSweep.verify = (value == "off") ? "" : value;
+    }
+    else {
+        cerr << "Unknown option: " << key << endl;
+        return false;
+    }
+    return true;
+}
+
+// Corre o varrimento: algoritmo x threads x tamanho x bloco. O speedup das versões paralelas usa a
+// mediana do algoritmo sequencial de referência (Line ou Block) se este também estiver no varrimento
+int RunSweep() {
+    vector<AlgoEntry> registry = algorithm_registry();
+    vector<AlgoEntry> selected;
+    for (const string &name : globalSweep.algorithms) {
+        auto it = find_if(registry.begin(), registry.end(), [&](const AlgoEntry &e) { return e.name == name; });
+        if (it == registry.end()) {
+            cerr << "Unknown algorithm: " << name << endl;
+            return 1;
+        }
+        selected.push_back(*it);
+    }
+    if (selected.empty() || globalSweep.sizes.empty()) {
+        cerr << "Sweep needs --algos and --sizes" << endl;
+        return 1;
+    }
+    // Sequenciais primeiro, para que as referências de speedup já existam
+    stable_partition(selected.begin(), selected.end(), [](const AlgoEntry &e) { return e.baseline.empty(); });
+
+    vector<int> threadCounts = globalSweep.threads;
+    int defaultThreads = omp_get_max_threads();
+    if (threadCounts.empty())
+        threadCounts.push_back(defaultThreads);
+    string path = globalSweep.output;
+    if (path.empty())
+        path = globalSweep.json ? "metrics_cpp/sweep_cpp.jsonl" : "metrics_cpp/sweep_cpp.csv";
+    WriteResultHeader(path, globalSweep.json);
+
+    int maxN = *max_element(globalSweep.sizes.begin(), globalSweep.sizes.end());
+    globalArena.reserve((size_t)maxN * maxN);
+
+    map<string, double> serialMedian;  // "algoritmo/n/bloco" -> mediana
+    map<int, VerifyCase> verifyCases;  // entradas aleatórias e referência por N, com --verify on
+    bool allPassed = true;
+    CounterSample sample;
+    for (const AlgoEntry &algo : selected) {
+        vector<int> blocks = algo.usesBlock ? globalSweep.blockSizes : vector<int>{0};
+        for (int t : threadCounts) {
+            omp_set_num_threads(max(1, t));
+            int threads = omp_get_max_threads();
+            for (int n : globalSweep.sizes) {
+                for (int bs : blocks) {
+                    for (const string &dtype : globalSweep.dtypes) {
+                        // Tipos diferentes de double só existem para os kernels template (não Simd/BlockPacked/Strassen/Morton)
+                        GemmAlgo typedAlgo;
+                        double error = NAN;
+                        bool typed = dtype != "double";
+                        if (typed && (!gemm_algo_from_name(algo.name, typedAlgo) || typedAlgo == GEMM_SIMD || typedAlgo == GEMM_STRASSEN || typedAlgo == GEMM_MORTON)) {
+                            cout << "Skipping " << algo.name << " for dtype " << dtype << " (double only)" << endl;
+                            continue;
+                        }
+                        bool parallel = !algo.baseline.empty() || algo.name == "Strassen" || algo.name == "Morton";
+                        BenchStats st = RunBenchmark([&] {
+                            if (!typed)
+                                return algo.run(n, bs);
+                            TypedResult res;
+                            RunTypedGemm(dtype, typedAlgo, n, bs > 0 ? bs : globalBlockSize, res);
+                            error = res.error;
+                            return res.time;
+                        }, &sample, parallel);
+                        string key = "/" + to_string(n) + "/" + to_string(bs) + "/" + dtype;
+                        double speedup = 1.0, efficiency = 1.0;
+                        if (algo.baseline.empty()) {
+                            if (!serialMedian.count(algo.name + key))
+                                serialMedian[algo.name + key] = st.median;
+                        } else {
+                            auto ref = serialMedian.find(algo.baseline + key);
+                            speedup = (ref != serialMedian.end()) ? ref->second / st.median : 0.0;
+                            efficiency = speedup / threads;
+                        }
+                        // Bloco 0: o do perfil de afinação (ou o global), registado com o valor efetivo
+                        GemmOptions effective = registry_gemm_options(algo.name, bs);
+                        if (bs == 0 && (algo.name == "Block" || algo.name == "BlockParallel"))
+                            effective = tuned_options(effective.algo, n);
+                        int shownBs = algo.usesBlock ? effective.bkSize : 0;
+                        int numBlocks = shownBs > 0 ? (int)pow((double)((n + shownBs - 1) / shownBs), 3) : 0;
+                        ResultRow row = {algo.name, n, shownBs, numBlocks, st, sample, speedup, efficiency, threads, 0, 0, 0, dtype, error, "", NAN, 1, NAN, NAN, 0.0};
+                        if (globalSweep.verify == "on") {
+                            bool pass;
+                            if (typed) {
+                                row.verifyRatio = error / typed_tolerance(dtype, n);
+                                pass = error <= typed_tolerance(dtype, n);
+                            } else {
+                                if (!verifyCases.count(n))
+                                    verifyCases[n] = make_verify_case(n, INPUT_RANDOM);
+                                VerifyResult vr = VerifyGemm(verifyCases[n], effective, 'N', 'N');
+                                row.verifyRatio = vr.ratio;
+                                pass = vr.pass;
+                            }
+                            row.verified = pass ? "pass" : "fail";
+                            if (!pass) {
+                                cerr << "Verification FAILED: " << algo.name << " N=" << n << " block " << bs << " " << dtype
+                                     << " (error/tolerance " << row.verifyRatio << ")" << endl;
+                                allPassed = false;
+                            }
+                        }
+                        if (algo.name == "Simd") {
+                            row.mc = SIMD_MC;
+                            row.kc = SIMD_KC;
+                            row.nc = SIMD_NC;
+                        } else if (algo.name == "BlockPacked") {
+                            // Como em RunAutomatedTests: o bloco do varrimento é o KC
+                            row.blockSize = 0;
+                            row.mc = globalMC;
+                            row.kc = effective.kc;
+                            row.nc = globalNC;
+                        }
+                        WriteResultRow(path, row, globalSweep.json);
+                    }
+                }
+            }
+        }
+    }
+    omp_set_num_threads(defaultThreads);
+    cout << "Sweep results written to " << path << endl;
+    return allPassed ? 0 : 1;
+}
+
+// Verificação de todos os algoritmos pedidos: entradas aleatórias e adversariais, e nas dimensões com
+// comparação completa também as quatro combinações de op(A)/op(B). Devolve 1 se algum caso falhar.
+int RunVerification(vector<string> algos, vector<int> sizes) {
+    vector<AlgoEntry> registry = algorithm_registry();
+    if (algos.empty())
+        for (const AlgoEntry &e : registry)
+            algos.push_back(e.name);
+    if (sizes.empty())
+        sizes = {1, 31, 129, 257, 600, 1031};  // fora dos múltiplos de bloco, 600 e 1031 com um nível de Strassen
+
+    const string path = "metrics_cpp/verify_cpp.csv";
+    ofstream out(path);
+    out << "algorithm,size,input,op,threads,method,max_ulp,verify_ratio,verified" << endl;
+    int threads = omp_get_max_threads();
+    int failures = 0, total = 0;
+    const char *ops[4] = {"NN", "TN", "NT", "TT"};
+    for (int n : sizes) {
+        if (n <= 0)
+            continue;
+        for (int kind = INPUT_RANDOM; kind <= INPUT_ADVERSARIAL; kind++) {
+            VerifyCase vc = make_verify_case(n, (VerifyInput)kind);
+            for (const string &name : algos) {
+                if (find_if(registry.begin(), registry.end(), [&](const AlgoEntry &e) { return e.name == name; }) == registry.end()) {
+                    cerr << "Unknown algorithm: " << name << endl;
+                    return 1;
+                }
+                for (int o = 0; o < (n <= VERIFY_FULL_MAX ? 4 : 1); o++) {
+                    VerifyResult vr = VerifyGemm(vc, registry_gemm_options(name, 0), ops[o][0], ops[o][1]);
+                    total++;
+                    if (!vr.pass)
+                        failures++;
+                    cout << setw(16) << name << setw(6) << n << setw(13) << verify_input_name(vc.kind) << setw(4) << ops[o]
+                         << setw(11) << vr.method << "  ratio " << setw(12) << vr.ratio << "  max ulp " << setw(10) << vr.maxUlp
+                         << "  " << (vr.pass ? "pass" : "FAIL") << endl;
+                    out << name << "," << n << "," << verify_input_name(vc.kind) << "," << ops[o] << "," << threads << "," << vr.method
+                        << "," << format_metric(vr.maxUlp, false) << "," << vr.ratio << "," << (vr.pass ? "pass" : "fail") << endl;
+                }
+            }
+        }
+    }
+    cout << (total - failures) << "/" << total << " checks passed. Results written to " << path << endl;
+    return failures == 0 ? 0 : 1;
+}
+
+// Autotuner: afina Block, BlockParallel e as versões paralelas por linha para cada N e guarda o vencedor no perfil.
+// Pesquisa podada: grelha grossa (blocos quadrados 32..512; threads P, P/2, P/4, ...; schedules static, dynamic e
+// guided), depois refinamento local coordenada a coordenada (bm, bk, bn, threads) com passos de ~1/4 do valor,
+// até não haver melhoria ou se esgotarem TUNE_MAX_EVALS pontos. Cada ponto é o mínimo de até TUNE_REPS execuções
+// e deixa de ser repetido quando uma execução já é 1.5x mais lenta que o melhor ponto.
+const int TUNE_REPS = 3;
+const int TUNE_MAX_EVALS = 48;
+const vector<string> TUNABLE = {"Block", "BlockParallel", "LineExtParallel", "LineIntParallel"};
+
+struct TuneSearch {
+    GemmAlgo algo;
+    int n;
+    double *A, *B, *C;
+    map<string, double> seen;  // parâmetros já medidos -> tempo
+    TuneEntry best;
+    double bestTime;
+    int evals;
+};
+
+double tune_eval(TuneSearch &ts, const TuneEntry &cand) {
+    string key = to_string(cand.bm) + "/" + to_string(cand.bk) + "/" + to_string(cand.bn) + "/" + to_string(cand.threads) + "/" +
+                 schedule_name(cand.schedule) + "/" + to_string(cand.chunk);
+    auto it = ts.seen.find(key);
+    if (it != ts.seen.end())
+        return it->second;
+    if (ts.evals >= TUNE_MAX_EVALS)
+        return INFINITY;
+    GemmOptions opt(ts.algo, cand.bk);
+    opt.bm = cand.bm;
+    opt.bn = cand.bn;
+    opt.threads = cand.threads;
+    opt.schedule = cand.schedule;
+    opt.chunk = cand.chunk;
+    double best = INFINITY;
+    for (int r = 0; r < TUNE_REPS; r++) {
+        double start = omp_get_wtime();
+        gemm('N', 'N', ts.n, ts.n, ts.n, 1.0, ts.A, ts.n, ts.B, ts.n, 0.0, ts.C, ts.n, opt);
+        double t = omp_get_wtime() - start;
+        best = min(best, t);
+        if (t > 1.5 * ts.bestTime)
+            break;
+    }
+    ts.evals++;
+    ts.seen[key] = best;
+    if (best < ts.bestTime) {
+        ts.best = cand;
+        ts.bestTime = best;
+        cout << "  " << setw(8) << fixed << setprecision(4) << best << defaultfloat << " s  bm/bk/bn " << cand.bm << "/" << cand.bk
+             << "/" << cand.bn << ", threads " << cand.threads << ", " << schedule_name(cand.schedule) << "," << cand.chunk << endl;
+    }
+    return best;
+}
+
+TuneEntry autotune_kernel(GemmAlgo algo, int n) {
+    bool blocked = (algo == GEMM_BLOCK || algo == GEMM_BLOCK_PARALLEL);
+    bool parallel = (algo != GEMM_BLOCK);
+    int P = omp_get_max_threads();
+    Matrix A, B, C;
+    globalArena.views(n, n, n, A, B, C);
+    initialize_matrices(A.data, B.data, C.data, n, n);
+    TuneSearch ts = {algo, n, A.data, B.data, C.data, {}, {}, INFINITY, 0};
+
+    // Ponto de partida: a configuração atual (bloco global, todas as threads, static)
+    int b0 = blocked ? min(globalBlockSize, n) : 0;
+    TuneEntry start = {gemm_algo_name(algo), size_class(n), P, b0, b0, b0, parallel ? P : 0, omp_sched_static, 0, 0.0};
+    cout << "\n[Autotune] " << start.kernel << " N=" << n << " (size class " << start.sizeClass << ", " << P << " threads)" << endl;
+    gemm('N', 'N', n, n, n, 1.0, ts.A, n, ts.B, n, 0.0, ts.C, n, GemmOptions(algo));  // aquecimento (páginas, caches)
+    tune_eval(ts, start);
+
+    if (blocked) {
+        for (int b : {32, 48, 64, 96, 128, 192, 256, 384, 512}) {
+            if (b > n && b != 32)
+                continue;
+            TuneEntry c = ts.best;
+            c.bm = c.bk = c.bn = b;
+            tune_eval(ts, c);
+        }
+    }
+    if (parallel) {
+        for (int t = P / 2; t >= 1; t /= 2) {
+            TuneEntry c = ts.best;
+            c.threads = t;
+            tune_eval(ts, c);
+        }
+    }
+    if (!blocked) {
+        const pair<omp_sched_t, int> schedules[] = {{omp_sched_static, 1}, {omp_sched_dynamic, 1}, {omp_sched_dynamic, 8}, {omp_sched_guided, 0}};
+        for (const auto &s : schedules) {
+            TuneEntry c = ts.best;
+            c.schedule = s.first;
+            c.chunk = s.second;
+            tune_eval(ts, c);
+        }
+    }
+
+    // Refinamento local: cada coordenada +/- um passo; repete enquanto houver melhoria
+    vector<int TuneEntry::*> dims;
+    if (blocked)
+        dims = {&TuneEntry::bm, &TuneEntry::bk, &TuneEntry::bn};
+    if (parallel)
+        dims.push_back(&TuneEntry::threads);
+    bool improved = true;
+    while (improved && ts.evals < TUNE_MAX_EVALS) {
+        double before = ts.bestTime;
+        for (int TuneEntry::*dim : dims) {
+            for (int dir : {-1, 1}) {
+                TuneEntry c = ts.best;
+                int v = c.*dim;
+                int step = (dim == &TuneEntry::threads) ? max(1, v / 4) : max(8, (v / 4 + 4) / 8 * 8);
+                int lo = (dim == &TuneEntry::threads) ? 1 : 8;
+                int hi = (dim == &TuneEntry::threads) ? P : max(n, 8);
+                int nv = v + dir * step;
+                if (nv < lo || nv > hi)
+                    continue;
+                c.*dim = nv;
+                tune_eval(ts, c);
+            }
+        }
+        improved = ts.bestTime < before;
+    }
+
+    ts.best.mflops = 2.0 * n * n * (double)n / (ts.bestTime * 1.0e6);
+    cout << "  best after " << ts.evals << " points: " << ts.bestTime << " s, " << ts.best.mflops << " MFlops" << endl;
+    return ts.best;
+}
+
+// Afina cada kernel pedido (por omissão todos os de TUNABLE) em cada N e grava o perfil da máquina
+int RunAutotune(vector<string> algos, vector<int> sizes) {
+    if (algos.empty())
+        algos = TUNABLE;
+    if (sizes.empty())
+        sizes = {512, 1024};
+    for (const string &name : algos) {
+        if (find(TUNABLE.begin(), TUNABLE.end(), name) == TUNABLE.end()) {
+            cerr << "Autotune supports Block, BlockParallel, LineExtParallel and LineIntParallel, not " << name << endl;
+            return 1;
+        }
+    }
+    if (globalProfile.path == "off")
+        globalProfile.path = "";
+    int maxN = *max_element(sizes.begin(), sizes.end());
+    globalArena.reserve((size_t)maxN * maxN);
+    for (const string &name : algos) {
+        GemmAlgo algo;
+        if (!gemm_algo_from_name(name, algo)) {
+            cerr << "Unknown algorithm: " << name << endl;
+            return 1;
+        }
+        for (int n : sizes) {
+            TuneEntry e = autotune_kernel(algo, n);
+            auto same = [&](const TuneEntry &x) { return x.kernel == e.kernel && x.sizeClass == e.sizeClass; };
+            globalProfile.entries.erase(remove_if(globalProfile.entries.begin(), globalProfile.entries.end(), same), globalProfile.entries.end());
+            globalProfile.entries.push_back(e);
+        }
+    }
+    if (!save_profile(globalProfile))
+        return 1;
+    cout << "\nTuning profile written to " << profile_path() << " (" << globalProfile.entries.size() << " entries)" << endl;
+    return 0;
+}
+
+// Estudo de escalabilidade das versões paralelas (as que têm baseline no registo)
+// Strong: N fixo, p = 1..P. Weak: N_p = N_1 * cbrt(p), trabalho (N^3) por thread constante.
+// speedup S = T1/Tp (no weak, S = T1 * (N_p/N_1)^3 / Tp), eficiência E = S/p,
+// Karp-Flatt e = (1/S - 1/p) / (1 - 1/p): se e cresce com p, o limite é overhead e não a parte série.
+// Com SMT há duas séries: smt-off (uma CPU por núcleo físico) e smt-on (CPUs irmãs adjacentes).
+struct ScalingSeries {
+    string name;
+    vector<int> cpus;  // thread i fixada em cpus[i]
+};
+
+vector<ScalingSeries> scaling_series() {
+    const NumaTopology &topo = numa_topology();
+    vector<int> cores;  // ordem dos núcleos físicos pela primeira CPU de cada um
+    map<int, vector<int>> siblings;
+    for (int c : topo.cpus) {
+        int core = topo.cpuCore[c];
+        if (!siblings.count(core))
+            cores.push_back(core);
+        siblings[core].push_back(c);
+    }
+    ScalingSeries off = {"smt-off", {}}, on = {"smt-on", {}};
+    for (int core : cores) {
+        off.cpus.push_back(siblings[core][0]);
+        for (int c : siblings[core])
+            on.cpus.push_back(c);
+    }
+    if (on.cpus.size() == off.cpus.size()) {
+        off.name = "no-smt";
+        return {off};
+    }
+    return {off, on};
+}
+
+double karp_flatt(double speedup, int p) {
+    if (p <= 1 || speedup <= 0.0)
+        return 0.0;
+    return (1.0 / speedup - 1.0 / p) / (1.0 - 1.0 / p);
+}
+
+int RunScalingStudy(const string &mode, int baseN) {
+    vector<AlgoEntry> selected;
+    for (const AlgoEntry &e : algorithm_registry()) {
+        bool wanted = globalSweep.algorithms.empty() ||
+                      find(globalSweep.algorithms.begin(), globalSweep.algorithms.end(), e.name) != globalSweep.algorithms.end();
+        if (!e.baseline.empty() && wanted)
+            selected.push_back(e);
+    }
+    if (selected.empty() || baseN <= 0) {
+        cerr << "Scaling study needs a parallel algorithm and N > 0" << endl;
+        return 1;
+    }
+
+    int defaultThreads = omp_get_max_threads();
+    vector<ScalingSeries> series = scaling_series();
+    vector<string> modes;
+    if (mode == "strong" || mode == "both") modes.push_back("strong");
+    if (mode == "weak" || mode == "both") modes.push_back("weak");
+
+    string path = "metrics_cpp/scaling_cpp.csv";
+    ofstream out(path);
+    if (!out.is_open()) {
+        cerr << "Error opening file " << path << endl;
+        return 1;
+    }
+    out << "mode,algorithm,smt,threads,size,blockSize,time,mflops,speedup,efficiency,karp_flatt" << endl;
+
+    for (const ScalingSeries &ser : series) {
+        int P = (int)ser.cpus.size();
+        vector<int> counts = globalSweep.threads;
+        if (counts.empty()) {
+            for (int p = 1; p < P; p *= 2)
+                counts.push_back(p);
+            counts.push_back(P);
+        }
+        for (const string &m : modes) {
+            int maxN = baseN;
+            for (int p : counts)
+                maxN = max(maxN, m == "weak" ? (int)lround(baseN * cbrt((double)min(p, P))) : baseN);
+            globalArena.reserve((size_t)maxN * maxN);
+
+            for (const AlgoEntry &algo : selected) {
+                int bs = algo.usesBlock ? globalBlockSize : 0;
+                cout << "\n" << m << " scaling, " << algo.name << ", " << ser.name << " (" << P << " CPUs), N1 = " << baseN << endl;
+                cout << setw(8) << "threads" << setw(8) << "N" << setw(12) << "time(s)" << setw(10) << "speedup"
+                     << setw(8) << "eff" << setw(12) << "karp-flatt" << endl;
+                double t1 = 0.0;
+                // T1 é sempre medido primeiro, com uma thread na primeira CPU da série
+                vector<int> points = {1};
+                for (int p : counts)
+                    points.push_back(max(1, min(p, P)));
+                sort(points.begin(), points.end());
+                points.erase(unique(points.begin(), points.end()), points.end());
+                for (int p : points) {
+                    threadCpuOverride.assign(ser.cpus.begin(), ser.cpus.begin() + p);
+                    omp_set_num_threads(p);
+                    apply_thread_binding(BIND_CLOSE);
+                    int n = (m == "weak") ? (int)lround(baseN * cbrt((double)p)) : baseN;
+                    double tp = RunBenchmark([&] { return algo.run(n, bs); }).median;
+                    if (p == 1 && t1 == 0.0)
+                        t1 = tp;
+                    double work = pow((double)n / baseN, 3);  // 1 no strong scaling
+                    double speedup = (tp > 0.0) ? t1 * work / tp : 0.0;
+                    double efficiency = speedup / p;
+                    double kf = karp_flatt(speedup, p);
+                    double mflops = (tp > 0.0) ? 2.0 * n * n * n / (tp * 1e6) : 0.0;
+                    cout << setw(8) << p << setw(8) << n << setw(12) << fixed << setprecision(4) << tp
+                         << setw(10) << setprecision(2) << speedup << setw(8) << efficiency
+                         << setw(12) << setprecision(4) << kf << defaultfloat << endl;
+                    out << m << "," << algo.name << "," << ser.name << "," << p << "," << n << "," << bs << ","
+                        << tp << "," << mflops << "," << speedup << "," << efficiency << "," << kf << endl;
+                }
+            }
+        }
+    }
+
+    threadCpuOverride.clear();
+    omp_set_num_threads(defaultThreads);
+    apply_thread_binding(globalNuma.bind);
+    out.close();
+    cout << "Scaling results written to " << path << endl;
+    return 0;
+}
+
+// Modelo roofline
+// Tetos medidos no próprio host: largura de banda tipo STREAM (triad a = b + s*c, 24 bytes por elemento,
+// sem contar write-allocate) com conjuntos de trabalho dimensionados para L1, L2, L3 e DRAM, e pico de
+// FMA com acumuladores independentes suficientes para esconder a latência. Para cada kernel a intensidade
+// operacional (FLOP/byte) vem dos bytes contados pelo PAPI em cada nível (falhas * 64 bytes); sem contadores
+// usa-se o tráfego compulsório 4*N^2*8 para DRAM, o que dá um limite superior da intensidade.
+// Atingível = min(pico, intensidade * largura de banda do nível); o nível que mais limita define o 'bound'.
+
+struct RooflineCeilings {
+    int threads;
+    double bandwidth[4];  // GB/s: L1, L2, L3, DRAM
+    double peak;          // GFLOP/s
+};
+
+const char *ROOF_LEVELS[4] = {"L1", "L2", "L3", "DRAM"};
+const int CACHE_LINE = 64;
+
+long cache_size(int level) {
+    long size = 0;
+    if (level == 1) size = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    else if (level == 2) size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    else if (level == 3) size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    static const long fallback[4] = {0, 32L << 10, 1L << 20, 32L << 20};
+    return size > 0 ? size : fallback[level];
+}
+
+// Triad repetida por cada thread sobre os seus próprios vetores (first-touch); devolve GB/s agregados
+double stream_triad(size_t bytesPerThread, int threads) {
+    size_t n = max<size_t>(bytesPerThread / (3 * sizeof(double)), 512);
+    long iters = max(1L, (long)(2.0e9 / (24.0 * n)));
+    double best = 0.0;
+    for (int trial = 0; trial < 3; trial++) {
+        double start = 0.0, elapsed = 0.0;
+#pragma omp parallel num_threads(threads)
+        {
+            double *a = alloc_aligned(n), *b = alloc_aligned(n), *c = alloc_aligned(n);
+            for (size_t i = 0; i < n; i++) {
+                a[i] = 0.0;
+                b[i] = 1.0;
+                c[i] = 2.0;
+            }
+#pragma omp barrier
+#pragma omp master
+            start = omp_get_wtime();
+#pragma omp barrier
+            for (long it = 0; it < iters; it++) {
+                double s = 1.0 + 1e-9 * it;
+#pragma omp simd
+                for (size_t i = 0; i < n; i++)
+                    a[i] = b[i] + s * c[i];
+                asm volatile("" : : "r"(a) : "memory");
+            }
+#pragma omp barrier
+#pragma omp master
+            elapsed = omp_get_wtime() - start;
+            free(a);
+            free(b);
+            free(c);
+        }
+        best = max(best, 24.0 * n * iters * threads / elapsed / 1e9);
+    }
+    return best;
+}
+
+// Cadeias de FMA independentes; devolve o número de FLOPs feitos
+double fma_chains_scalar(long iters, double *sink) {
+    double acc[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    const double x = 0.999999, y = 1e-6;
+    for (long it = 0; it < iters; it++)
+#pragma GCC unroll 8
+        for (int k = 0; k < 8; k++)
+            acc[k] = acc[k] * x + y;
+    for (int k = 0; k < 8; k++) *sink += acc[k];
+    return 2.0 * 8 * iters;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// 12 acumuladores ymm: latência 4-5 ciclos x 2 portas FMA
+__attribute__((target("avx2,fma")))
+static double fma_chains_avx2(long iters, double *sink) {
+    __m256d acc[12];
+    for (int k = 0; k < 12; k++) acc[k] = _mm256_setzero_pd();
+    const __m256d x = _mm256_set1_pd(0.999999), y = _mm256_set1_pd(1e-6);
+    for (long it = 0; it < iters; it++)
+#pragma GCC unroll 12
+        for (int k = 0; k < 12; k++)
+            acc[k] = _mm256_fmadd_pd(acc[k], x, y);
+    double out[4];
+    for (int k = 1; k < 12; k++) acc[0] = _mm256_add_pd(acc[0], acc[k]);
+    _mm256_storeu_pd(out, acc[0]);
+    *sink += out[0] + out[1] + out[2] + out[3];
+    return 2.0 * 4 * 12 * iters;
+}
+
+__attribute__((target("avx512f")))
+static double fma_chains_avx512(long iters, double *sink) {
+    __m512d acc[16];
+    for (int k = 0; k < 16; k++) acc[k] = _mm512_setzero_pd();
+    const __m512d x = _mm512_set1_pd(0.999999), y = _mm512_set1_pd(1e-6);
+    for (long it = 0; it < iters; it++)
+#pragma GCC unroll 16
+        for (int k = 0; k < 16; k++)
+            acc[k] = _mm512_fmadd_pd(acc[k], x, y);
+    double out[8];
+    for (int k = 1; k < 16; k++) acc[0] = _mm512_add_pd(acc[0], acc[k]);
+    _mm512_storeu_pd(out, acc[0]);
+    for (int k = 0; k < 8; k++) *sink += out[k];
+    return 2.0 * 8 * 16 * iters;
+}
+#endif
+
+// Pico de FMA em GFLOP/s com 'threads' threads, usando o mesmo ISA do micro-kernel SIMD
+double fma_peak(int threads) {
+    const string isa = select_micro_kernel().isa;
+    double (*chains)(long, double *) = fma_chains_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+    if (isa == "AVX-512") chains = fma_chains_avx512;
+    else if (isa == "AVX2") chains = fma_chains_avx2;
+#endif
+    const long iters = 20000000;
+    double best = 0.0, sink = 0.0;
+    for (int trial = 0; trial < 3; trial++) {
+        double flops = 0.0;
+        double start = omp_get_wtime();
+#pragma omp parallel num_threads(threads) reduction(+ : flops, sink)
+        flops += chains(iters, &sink);
+        best = max(best, flops / (omp_get_wtime() - start) / 1e9);
+    }
+    if (sink == 42.0) cout << "";  // impede que o compilador descarte as cadeias
+    return best;
+}
+
+// L1/L2 são privadas: meia cache por thread. L3 é partilhada entre as threads; DRAM usa 4x a L3 (>= 256 MB)
+RooflineCeilings measure_ceilings(int threads) {
+    RooflineCeilings ceil;
+    ceil.threads = threads;
+    ceil.bandwidth[0] = stream_triad(cache_size(1) / 2, threads);
+    ceil.bandwidth[1] = stream_triad(cache_size(2) / 2, threads);
+    ceil.bandwidth[2] = stream_triad(cache_size(3) / 2 / threads, threads);
+    ceil.bandwidth[3] = stream_triad(max(4 * cache_size(3), 256L << 20) / threads, threads);
+    ceil.peak = fma_peak(threads);
+    return ceil;
+}
+
+// Mede os tetos (1 thread e todas as threads) e, com 'kernels', coloca cada kernel no roofline para o tamanho n
+int RunRoofline(int n, bool kernels) {
+    int maxThreads = omp_get_max_threads();
+    vector<RooflineCeilings> ceilings = {measure_ceilings(1)};
+    if (maxThreads > 1)
+        ceilings.push_back(measure_ceilings(maxThreads));
+
+    const string ceilPath = "metrics_cpp/roofline_ceilings_cpp.csv";
+    ofstream ceilOut(ceilPath);
+    ceilOut << "threads,ceiling,value,unit" << endl;
+    cout << "\nRoofline ceilings (" << select_micro_kernel().isa << ")" << endl;
+    for (const RooflineCeilings &c : ceilings) {
+        cout << "  " << c.threads << " thread(s): peak " << fixed << setprecision(1) << c.peak << " GFLOP/s";
+        ceilOut << c.threads << ",peak," << c.peak << ",GFLOP/s" << endl;
+        for (int l = 0; l < 4; l++) {
+            cout << " - " << ROOF_LEVELS[l] << " " << c.bandwidth[l] << " GB/s";
+            ceilOut << c.threads << "," << ROOF_LEVELS[l] << "," << c.bandwidth[l] << ",GB/s" << endl;
+        }
+        cout << defaultfloat << endl;
+    }
+    ceilOut.close();
+    cout << "Ceilings written to " << ceilPath << endl;
+    if (!kernels)
+        return 0;
+
+    const vector<string> names = {"Standard", "Line", "Block", "Simd", "LineExtParallel", "LineIntParallel", "BlockParallel"};
+    vector<AlgoEntry> registry = algorithm_registry();
+    const string path = "metrics_cpp/roofline_cpp.csv";
+    ofstream out(path);
+    out << "algorithm,threads,size,level,bytes,bytes_source,flops,intensity,bandwidth,peak,attainable,achieved,pct_of_roof,bound" << endl;
+    globalArena.reserve((size_t)n * n);
+
+    cout << "\n" << setw(16) << "kernel" << setw(6) << "thr" << setw(6) << "level" << setw(12) << "FLOP/byte"
+         << setw(12) << "attainable" << setw(10) << "achieved" << setw(8) << "% roof" << "  bound" << endl;
+    const char *missEvents[4] = {nullptr, "PAPI_L1_DCM", "PAPI_L2_DCM", "PAPI_L3_TCM"};
+    for (const string &name : names) {
+        auto it = find_if(registry.begin(), registry.end(), [&](const AlgoEntry &e) { return e.name == name; });
+        bool parallel = !it->baseline.empty();
+        const RooflineCeilings &ceil = parallel ? ceilings.back() : ceilings.front();
+        CounterSample sample;
+        double t = RunBenchmark([&] { return it->run(n, globalBlockSize); }, &sample, parallel).median;
+        double flops = 2.0 * n * n * n;
+        double achieved = flops / t / 1e9;
+
+        // Tráfego que chega a cada nível: falhas do nível acima * linha de cache
+        double bytes[4] = {-1, -1, -1, -1};
+        string source[4] = {"", "", "", ""};
+        for (int l = 1; l < 4; l++) {
+            long long misses = sample.get(missEvents[l]);
+            if (misses >= 0) {
+                bytes[l] = (double)misses * CACHE_LINE;
+                source[l] = missEvents[l];
+            }
+        }
+        if (bytes[3] < 0) {
+            bytes[3] = 4.0 * n * n * sizeof(double);
+            source[3] = "compulsory";
+        }
+        int boundLevel = -1;
+        double minRoof = ceil.peak;
+        for (int l = 1; l < 4; l++)
+            if (bytes[l] > 0 && (flops / bytes[l]) * ceil.bandwidth[l] < minRoof) {
+                minRoof = (flops / bytes[l]) * ceil.bandwidth[l];
+                boundLevel = l;
+            }
+        for (int l = 1; l < 4; l++) {
+            if (bytes[l] <= 0)
+                continue;
+            double oi = flops / bytes[l];
+            double attainable = min(ceil.peak, oi * ceil.bandwidth[l]);
+            string bound = (oi * ceil.bandwidth[l] < ceil.peak) ? "memory" : "compute";
+            out << name << "," << ceil.threads << "," << n << "," << ROOF_LEVELS[l] << "," << bytes[l] << "," << source[l] << ","
+                << flops << "," << oi << "," << ceil.bandwidth[l] << "," << ceil.peak << "," << attainable << ","
+                << achieved << "," << 100.0 * achieved / attainable << "," << bound << endl;
+            cout << setw(16) << name << setw(6) << ceil.threads << setw(6) << ROOF_LEVELS[l] << setw(12) << setprecision(3) << oi
+                 << setw(12) << setprecision(1) << fixed << attainable << setw(10) << achieved << setw(7)
+                 << 100.0 * achieved / attainable << "%  " << bound << (l == boundLevel ? " *" : "") << defaultfloat << endl;
+        }
+    }
+    out.close();
+    cout << "(* = tightest roof)  Roofline results written to " << path << endl;
+    return 0;
+}
+
+// Formato binário de matrizes (.cpdm)
+// Cabeçalho de 64 bytes (little-endian) numa página própria; os dados começam em dataOffset (múltiplo de
+// MATRIX_FILE_ALIGN), por isso um mmap do ficheiro dá um ponteiro alinhado sem cópia. Layouts:
+//  - row-major: elemento (i, j) em i * ld + j (ld >= cols, linhas podem ter padding);
+//  - column-major: elemento (i, j) em j * ld + i (ld >= rows); é a transposta row-major, usada com op = 'T';
+//  - tiled: tiles tile x tile row-major, por ordem row-major de tiles, bordas completadas com zeros (out-of-core).
+// dtype é o índice em DTYPES (double, float, bf16, fp16).
+const char MATRIX_FILE_MAGIC[8] = {'C', 'P', 'D', 'M', 'A', 'T', '0', '1'};
+const uint64_t MATRIX_FILE_ALIGN = 4096;
+
+enum MatrixLayout { LAYOUT_ROW_MAJOR = 0, LAYOUT_COL_MAJOR = 1, LAYOUT_TILED = 2 };
+
+const char *matrix_layout_name(uint32_t layout) {
+    switch (layout) {
+        case LAYOUT_ROW_MAJOR: return "row";
+        case LAYOUT_COL_MAJOR: return "col";
+        case LAYOUT_TILED: return "tiled";
+    }
+    return "unknown";
+}
+
+struct MatrixFileHeader {
+    char magic[8];
+    uint32_t dtype;
+    uint32_t layout;
+    uint32_t tile;  // só no layout tiled
+    uint32_t reserved;
+    int64_t rows, cols;
+    int64_t ld;  // elementos entre linhas (row-major) ou colunas (column-major); tile nas tiles
+    uint64_t dataOffset;
+    uint64_t padding;
+};
+
+static_assert(sizeof(MatrixFileHeader) == 64, "matrix file header must be 64 bytes");
+
+size_t dtype_size(uint32_t dtype) {
+    return dtype == 0 ? sizeof(double) : dtype == 1 ? sizeof(float) : sizeof(uint16_t);
+}
+
+MatrixFileHeader make_matrix_header(int64_t rows, int64_t cols, uint32_t dtype, uint32_t layout, uint32_t tile) {
+    MatrixFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MATRIX_FILE_MAGIC, sizeof(h.magic));
+    h.dtype = dtype;
+    h.layout = layout;
+    h.tile = layout == LAYOUT_TILED ? tile : 0;
+    h.rows = rows;
+    h.cols = cols;
+    // Linhas (ou colunas) de double alinhadas a 64 bytes
+    int64_t inner = layout == LAYOUT_COL_MAJOR ? rows : cols;
+    int64_t perLine = 64 / dtype_size(dtype);
+    h.ld = layout == LAYOUT_TILED ? tile : (inner + perLine - 1) / perLine * perLine;
+    h.dataOffset = MATRIX_FILE_ALIGN;
+    return h;
+}
+
+size_t matrix_data_bytes(const MatrixFileHeader &h) {
+    size_t count;
+    if (h.layout == LAYOUT_TILED)
+        count = (size_t)((h.rows + h.tile - 1) / h.tile) * ((h.cols + h.tile - 1) / h.tile) * h.tile * h.tile;
+    else
+        count = (size_t)(h.layout == LAYOUT_COL_MAJOR ? h.cols : h.rows) * h.ld;
+    return count * dtype_size(h.dtype);
+}
+
+size_t matrix_index(const MatrixFileHeader &h, int64_t i, int64_t j) {
+    if (h.layout == LAYOUT_ROW_MAJOR)
+        return (size_t)i * h.ld + j;
+    if (h.layout == LAYOUT_COL_MAJOR)
+        return (size_t)j * h.ld + i;
+    size_t tilesC = (h.cols + h.tile - 1) / h.tile;
+    return ((i / h.tile) * tilesC + j / h.tile) * (size_t)h.tile * h.tile + (i % h.tile) * h.tile + j % h.tile;
+}
+
+bool valid_matrix_header(const MatrixFileHeader &h, size_t fileBytes) {
+    if (memcmp(h.magic, MATRIX_FILE_MAGIC, sizeof(h.magic)) != 0 || h.dtype >= DTYPES.size() || h.layout > LAYOUT_TILED)
+        return false;
+    if (h.rows <= 0 || h.cols <= 0 || h.rows > INT32_MAX || h.cols > INT32_MAX || h.dataOffset % MATRIX_FILE_ALIGN != 0)
+        return false;
+    if (h.layout == LAYOUT_TILED ? (h.tile == 0 || h.ld != (int64_t)h.tile) : h.ld < (h.layout == LAYOUT_COL_MAJOR ? h.rows : h.cols))
+        return false;
+    return h.dataOffset + matrix_data_bytes(h) <= fileBytes;
+}
+
+// Ficheiro de matriz mapeado em memória; data aponta para o primeiro elemento (dataOffset)
+struct MappedMatrix {
+    MatrixFileHeader h;
+    int fd;
+    void *base;
+    size_t bytes;
+    void *data;
+};
+
+// Abre e mapeia um ficheiro existente (só leitura, ou leitura/escrita com writable)
+bool map_matrix_file(const string &path, bool writable, MappedMatrix &m) {
+    m.base = nullptr;
+    m.fd = open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+    if (m.fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(m.fd, &st) != 0 || (size_t)st.st_size < sizeof(MatrixFileHeader) ||
+        pread(m.fd, &m.h, sizeof(m.h), 0) != (ssize_t)sizeof(m.h) || !valid_matrix_header(m.h, st.st_size)) {
+        close(m.fd);
+        return false;
+    }
+    m.bytes = m.h.dataOffset + matrix_data_bytes(m.h);
+    m.base = mmap(nullptr, m.bytes, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, m.fd, 0);
+    if (m.base == MAP_FAILED) {
+        close(m.fd);
+        return false;
+    }
+    m.data = (char *)m.base + m.h.dataOffset;
+    return true;
+}
+
+// Cria o ficheiro com o cabeçalho h e mapeia-o para escrita; os dados (e o padding) começam a zero
+bool create_matrix_file(const string &path, const MatrixFileHeader &h, MappedMatrix &m) {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    bool ok = ftruncate(fd, h.dataOffset + matrix_data_bytes(h)) == 0 && pwrite(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h);
+    close(fd);
+    return ok && map_matrix_file(path, true, m);
+}
+
+void unmap_matrix_file(MappedMatrix &m) {
+    if (m.base != nullptr) {
+        munmap(m.base, m.bytes);
+        close(m.fd);
+    }
+    m.base = nullptr;
+}
+
+double matrix_value(const MappedMatrix &m, int64_t i, int64_t j) {
+    size_t idx = matrix_index(m.h, i, j);
+    switch (m.h.dtype) {
+        case 0: return ((const double *)m.data)[idx];
+        case 1: return ((const float *)m.data)[idx];
+        case 2: return (float)((const bf16 *)m.data)[idx];
+        default: return (float)((const fp16 *)m.data)[idx];
+    }
+}
+
+void set_matrix_value(MappedMatrix &m, int64_t i, int64_t j, double v) {
+    size_t idx = matrix_index(m.h, i, j);
+    switch (m.h.dtype) {
+        case 0: ((double *)m.data)[idx] = v; break;
+        case 1: ((float *)m.data)[idx] = (float)v; break;
+        case 2: ((bf16 *)m.data)[idx] = bf16((float)v); break;
+        default: ((fp16 *)m.data)[idx] = fp16((float)v); break;
+    }
+}
+
+// Operando de gemm a partir de um ficheiro: double row-major e column-major são usados sem cópia (o
+// column-major como op = 'T'); os outros tipos e o layout tiled são convertidos para double row-major
+struct GemmOperand {
+    const double *ptr;
+    int ld;
+    char trans;
+    bool zeroCopy;
+    double *owned;
+};
+
+GemmOperand matrix_operand(const MappedMatrix &m) {
+    GemmOperand op = {nullptr, 0, 'N', true, nullptr};
+    if (m.h.dtype == 0 && m.h.layout != LAYOUT_TILED) {
+        op.ptr = (const double *)m.data;
+        op.ld = (int)m.h.ld;
+        op.trans = m.h.layout == LAYOUT_COL_MAJOR ? 'T' : 'N';
+        return op;
+    }
+    op.owned = alloc_aligned((size_t)m.h.rows * m.h.cols);
+    for (int64_t i = 0; i < m.h.rows; i++)
+        for (int64_t j = 0; j < m.h.cols; j++)
+            op.owned[(size_t)i * m.h.cols + j] = matrix_value(m, i, j);
+    op.ptr = op.owned;
+    op.ld = (int)m.h.cols;
+    op.zeroCopy = false;
+    return op;
+}
+
+// Subnormais tornam as operações de FP muito mais lentas em vários processadores; contados por operando
+size_t count_subnormals(const MappedMatrix &m) {
+    size_t count = 0;
+    for (int64_t i = 0; i < m.h.rows; i++)
+        for (int64_t j = 0; j < m.h.cols; j++)
+            if (fpclassify(matrix_value(m, i, j)) == FP_SUBNORMAL)
+                count++;
+    return count;
+}
+
+// Gera um ficheiro: "FICHEIRO:LINHASxCOLUNAS[:random|ones|subnormal|sparse|lower[:row|col|tiled[:dtype]]]"
+// random é uniforme em [-1, 1] (semente fixa), subnormal é random * 2^-1030 (subnormal em double),
+// sparse mantém 2% dos elementos de random e lower só o triângulo inferior
+bool make_matrix_file(const string &spec) {
+    vector<string> parts;
+    size_t pos = 0;
+    while (pos <= spec.size()) {
+        size_t end = spec.find(':', pos);
+        if (end == string::npos) end = spec.size();
+        parts.push_back(spec.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    long long rows = 0, cols = 0;
+    if (parts.size() < 2 || sscanf(parts[1].c_str(), "%lldx%lld", &rows, &cols) != 2 || rows <= 0 || cols <= 0) {
+        cerr << "Bad matrix spec " << spec << " (FILE:ROWSxCOLS[:random|ones|subnormal|sparse|lower[:row|col|tiled[:dtype]]])" << endl;
+        return false;
+    }
+    string dist = parts.size() > 2 ? parts[2] : "random";
+    string layout = parts.size() > 3 ? parts[3] : "row";
+    string dtype = parts.size() > 4 ? parts[4] : "double";
+    auto dt = find(DTYPES.begin(), DTYPES.end(), dtype);
+    if ((dist != "random" && dist != "ones" && dist != "subnormal" && dist != "sparse" && dist != "lower") || (layout != "row" && layout != "col" && layout != "tiled") ||
+        dt == DTYPES.end()) {
+        cerr << "Bad matrix spec " << spec << endl;
+        return false;
+    }
+    uint32_t lay = layout == "row" ? LAYOUT_ROW_MAJOR : layout == "col" ? LAYOUT_COL_MAJOR : LAYOUT_TILED;
+    MappedMatrix m;
+    if (!create_matrix_file(parts[0], make_matrix_header(rows, cols, dt - DTYPES.begin(), lay, globalBlockSize), m)) {
+        cerr << "Error creating " << parts[0] << endl;
+        return false;
+    }
+    srand(12345);
+    for (long long i = 0; i < rows; i++) {
+        for (long long j = 0; j < cols; j++) {
+            double v = dist == "ones" ? 1.0 : 2.0 * rand() / RAND_MAX - 1.0;
+            if ((dist == "sparse" && (double)rand() / RAND_MAX >= 0.02) || (dist == "lower" && j > i))
+                v = 0.0;
+            set_matrix_value(m, i, j, dist == "subnormal" ? ldexp(v, -1030) : v);
+        }
+    }
+    msync(m.base, m.bytes, MS_SYNC);
+    unmap_matrix_file(m);
+    cout << "Wrote " << parts[0] << " (" << rows << "x" << cols << ", " << dist << ", " << layout << ", " << dtype << ")" << endl;
+    return true;
+}
+
+// Multiplicação fora do núcleo (out-of-core) para matrizes maiores que a RAM
+// Os operandos são ficheiros .cpdm de double no layout tiled: todas as tiles têm T^2 elementos e começam num
+// múltiplo de página. C é produzido tile a tile: a tile de C fica em memória enquanto K percorre as tiles
+// A(I,K) e B(K,J), lidas por uma thread de I/O para um segundo par de buffers enquanto o par atual é multiplicado
+// (double buffering). O kernel de cada tile é o do registo (por omissão BlockParallel com o bloco global).
+// Lê 2 (N/T)^3 T^2 e escreve (N/T)^2 T^2 elementos: o I/O desce com 1/T, a memória são 5 T^2 doubles.
+struct TiledFile {
+    int fd;
+    int n, tile, tiles;  // tiles por dimensão
+    size_t bytes;
+    double *map;  // só com mmap
+};
+
+size_t tile_offset(const TiledFile &f, int ti, int tj) {
+    return MATRIX_FILE_ALIGN + ((size_t)ti * f.tiles + tj) * f.tile * f.tile * sizeof(double);
+}
+
+// pread/pwrite podem transferir menos do que o pedido; repete até ao fim
+bool pread_full(int fd, void *dst, size_t bytes, size_t offset) {
+    char *p = (char *)dst;
+    while (bytes > 0) {
+        ssize_t r = pread(fd, p, bytes, offset);
+        if (r <= 0)
+            return false;
+        p += r;
+        bytes -= r;
+        offset += r;
+    }
+    return true;
+}
+
+bool pwrite_full(int fd, const void *src, size_t bytes, size_t offset) {
+    const char *p = (const char *)src;
+    while (bytes > 0) {
+        ssize_t r = pwrite(fd, p, bytes, offset);
+        if (r <= 0)
+            return false;
+        p += r;
+        bytes -= r;
+        offset += r;
+    }
+    return true;
+}
+
+// Abre um ficheiro em tiles; com create cria-o (só o cabeçalho e o tamanho, as tiles são escritas depois).
+// Sem create falha se o cabeçalho não corresponder a n e tile.
+bool open_tiled(const string &path, int n, int tile, bool create, bool useMmap, TiledFile &f) {
+    MatrixFileHeader h = make_matrix_header(n, n, 0, LAYOUT_TILED, tile);
+    f.n = n;
+    f.tile = tile;
+    f.tiles = (n + tile - 1) / tile;
+    f.bytes = h.dataOffset + matrix_data_bytes(h);
+    f.map = nullptr;
+    f.fd = open(path.c_str(), create ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR, 0644);
+    if (f.fd < 0)
+        return false;
+    if (create) {
+        if (ftruncate(f.fd, f.bytes) != 0 || !pwrite_full(f.fd, &h, sizeof(h), 0)) {
+            close(f.fd);
+            return false;
+        }
+    } else {
+        MatrixFileHeader fh;
+        struct stat st;
+        if (!pread_full(f.fd, &fh, sizeof(fh), 0) || fstat(f.fd, &st) != 0 || !valid_matrix_header(fh, st.st_size) ||
+            fh.dtype != 0 || fh.layout != LAYOUT_TILED || fh.rows != n || fh.cols != n || fh.tile != (uint32_t)tile ||
+            fh.dataOffset != h.dataOffset) {
+            close(f.fd);
+            return false;
+        }
+    }
+    if (useMmap) {
+        void *p = mmap(nullptr, f.bytes, PROT_READ, MAP_SHARED, f.fd, 0);
+        if (p == MAP_FAILED) {
+            close(f.fd);
+            return false;
+        }
+        f.map = (double *)p;
+    }
+    return true;
+}
+
+void close_tiled(TiledFile &f) {
+    if (f.map != nullptr)
+        munmap(f.map, f.bytes);
+    close(f.fd);
+    f.fd = -1;
+}
+
+bool read_tile(const TiledFile &f, int ti, int tj, double *dst) {
+    size_t bytes = (size_t)f.tile * f.tile * sizeof(double);
+    if (f.map != nullptr) {
+        memcpy(dst, (const char *)f.map + tile_offset(f, ti, tj), bytes);  // as faltas de página ficam na thread de I/O
+        return true;
+    }
+    return pread_full(f.fd, dst, bytes, tile_offset(f, ti, tj));
+}
+
+// Cria (ou reutiliza, se o cabeçalho coincidir) um operando com os valores de initialize_matrices:
+// A = 1 e a linha i de B = i + 1, de modo que todos os elementos de C valem n (n + 1) / 2
+bool prepare_ooc_operand(const string &path, int n, int tile, bool isB) {
+    TiledFile f;
+    if (open_tiled(path, n, tile, false, false, f)) {
+        close_tiled(f);
+        return true;
+    }
+    cout << "Writing " << path << " (" << n << "x" << n << ", tile " << tile << ")" << endl;
+    if (!open_tiled(path, n, tile, true, false, f))
+        return false;
+    double *buffer = alloc_aligned((size_t)tile * tile);
+    bool ok = true;
+    for (int ti = 0; ti < f.tiles && ok; ti++) {
+        for (int tj = 0; tj < f.tiles && ok; tj++) {
+            for (int i = 0; i < tile; i++) {
+                int gi = ti * tile + i;
+                for (int j = 0; j < tile; j++) {
+                    int gj = tj * tile + j;
+                    buffer[(size_t)i * tile + j] = (gi < n && gj < n) ? (isB ? (double)(gi + 1) : 1.0) : 0.0;
+                }
+            }
+            ok = pwrite_full(f.fd, buffer, (size_t)tile * tile * sizeof(double), tile_offset(f, ti, tj));
+        }
+    }
+    free(buffer);
+    ok = ok && fsync(f.fd) == 0;
+    close_tiled(f);
+    return ok;
+}
+
+// Dois pares de buffers (A, B): a thread de I/O enche o par s % 2 com as tiles do passo s enquanto o cálculo
+// usa o outro. readySlot[k] guarda o passo carregado no par k (-1 = livre).
+struct OocPipeline {
+    double *A[2], *B[2];
+    long readySlot[2];
+    atomic<bool> failed;
+    mutex lock;
+    condition_variable changed;
+};
+
+int RunOutOfCore(const OocConfig &cfg, const string &algoName, int bkSize) {
+    int n = cfg.n, T = cfg.tile;
+    if (n <= 0 || T <= 0) {
+        cerr << "Out-of-core mode needs N > 0 and tile > 0" << endl;
+        return 1;
+    }
+    struct stat st = {0};
+    if (stat(cfg.dir.c_str(), &st) == -1 && mkdir(cfg.dir.c_str(), 0777) != 0) {
+        cerr << "Error creating directory " << cfg.dir << endl;
+        return 1;
+    }
+    string pathA = cfg.dir + "/A_" + to_string(n) + "_" + to_string(T) + ".cpdm";
+    string pathB = cfg.dir + "/B_" + to_string(n) + "_" + to_string(T) + ".cpdm";
+    string pathC = cfg.dir + "/C_" + to_string(n) + "_" + to_string(T) + ".cpdm";
+    if (!prepare_ooc_operand(pathA, n, T, false) || !prepare_ooc_operand(pathB, n, T, true)) {
+        cerr << "Error writing the tiled operands in " << cfg.dir << endl;
+        return 1;
+    }
+    TiledFile fA, fB, fC;
+    if (!open_tiled(pathA, n, T, false, cfg.useMmap, fA) || !open_tiled(pathB, n, T, false, cfg.useMmap, fB) ||
+        !open_tiled(pathC, n, T, true, false, fC)) {
+        cerr << "Error opening the tiled files in " << cfg.dir << endl;
+        return 1;
+    }
+    // Começa com a cache de páginas fria para os operandos, como se não coubessem em memória
+    posix_fadvise(fA.fd, 0, 0, POSIX_FADV_DONTNEED);
+    posix_fadvise(fB.fd, 0, 0, POSIX_FADV_DONTNEED);
+
+    GemmOptions opt = registry_gemm_options(algoName, bkSize);
+    int nt = fA.tiles;
+    size_t T2 = (size_t)T * T, tileBytes = T2 * sizeof(double);
+    long steps = (long)nt * nt * nt;
+    OocPipeline pipe;
+    for (int k = 0; k < 2; k++) {
+        pipe.A[k] = alloc_aligned(T2);
+        pipe.B[k] = alloc_aligned(T2);
+        pipe.readySlot[k] = -1;
+    }
+    pipe.failed = false;
+    double *Ctile = alloc_aligned(T2);
+    cout << "Out-of-core N=" << n << ", tile " << T << " (" << nt << "x" << nt << " tiles), " << (cfg.useMmap ? "mmap" : "pread")
+         << ", kernel " << algoName << " (block " << opt.bkSize << "), buffers " << (5 * tileBytes) / (1024 * 1024) << " MB" << endl;
+
+    double readTime = 0.0;
+    double start = omp_get_wtime();
+    thread reader([&] {
+        for (long s = 0; s < steps; s++) {
+            int slot = s % 2;
+            {
+                unique_lock<mutex> guard(pipe.lock);
+                pipe.changed.wait(guard, [&] { return pipe.readySlot[slot] == -1 || pipe.failed; });
+                if (pipe.failed)
+                    return;
+            }
+            int I = s / ((long)nt * nt), J = (s / nt) % nt, K = s % nt;
+            double t0 = omp_get_wtime();
+            bool ok = read_tile(fA, I, K, pipe.A[slot]) && read_tile(fB, K, J, pipe.B[slot]);
+            readTime += omp_get_wtime() - t0;
+            {
+                lock_guard<mutex> guard(pipe.lock);
+                if (ok)
+                    pipe.readySlot[slot] = s;
+                else
+                    pipe.failed = true;
+            }
+            pipe.changed.notify_all();
+            if (!ok)
+                return;
+        }
+    });
+
+    double stallTime = 0.0, computeTime = 0.0, writeTime = 0.0;
+    double expected = (double)n * (n + 1) / 2.0;
+    bool verified = true;
+    for (long s = 0; s < steps && !pipe.failed; s++) {
+        int slot = s % 2;
+        int I = s / ((long)nt * nt), J = (s / nt) % nt, K = s % nt;
+        double t0 = omp_get_wtime();
+        {
+            unique_lock<mutex> guard(pipe.lock);
+            pipe.changed.wait(guard, [&] { return pipe.readySlot[slot] == s || pipe.failed; });
+            if (pipe.failed)
+                break;
+        }
+        double t1 = omp_get_wtime();
+        stallTime += t1 - t0;
+        gemm('N', 'N', T, T, T, 1.0, pipe.A[slot], T, pipe.B[slot], T, K == 0 ? 0.0 : 1.0, Ctile, T, opt);
+        double t2 = omp_get_wtime();
+        computeTime += t2 - t1;
+        {
+            lock_guard<mutex> guard(pipe.lock);
+            pipe.readySlot[slot] = -1;
+        }
+        pipe.changed.notify_all();
+
+        if (K == nt - 1) {
+            for (int i = 0; i < T && I * T + i < n; i++)
+                for (int j = 0; j < T && J * T + j < n; j++)
+                    if (Ctile[(size_t)i * T + j] != expected)
+                        verified = false;
+            if (!pwrite_full(fC.fd, Ctile, tileBytes, tile_offset(fC, I, J))) {
+                {
+                    lock_guard<mutex> guard(pipe.lock);
+                    pipe.failed = true;
+                }
+                // acorda o leitor, que pode estar à espera de um slot livre
+                pipe.changed.notify_all();
+            }
+            writeTime += omp_get_wtime() - t2;
+        }
+    }
+    reader.join();
+    double wall = omp_get_wtime() - start;
+
+    for (int k = 0; k < 2; k++) {
+        free(pipe.A[k]);
+        free(pipe.B[k]);
+    }
+    free(Ctile);
+    close_tiled(fA);
+    close_tiled(fB);
+    close_tiled(fC);
+    if (pipe.failed) {
+        cerr << "I/O error during the out-of-core multiplication" << endl;
+        return 1;
+    }
+
+    // overlap: fração do tempo de leitura escondida atrás do cálculo (a leitura que não fez o cálculo esperar)
+    double readBytes = 2.0 * steps * tileBytes, writeBytes = (double)nt * nt * tileBytes;
+    double overlap = readTime > 0 ? max(0.0, 1.0 - stallTime / readTime) : 1.0;
+    double gflops = 2.0 * n * n * (double)n / (wall * 1.0e9);
+    double ioMBps = (readBytes + writeBytes) / (wall * 1024.0 * 1024.0);
+    cout << "Read " << readBytes / (1024.0 * 1024.0 * 1024.0) << " GB in " << readTime << " s, written "
+         << writeBytes / (1024.0 * 1024.0 * 1024.0) << " GB in " << writeTime << " s" << endl;
+    cout << "Wall " << wall << " s, compute " << computeTime << " s, stall " << stallTime << " s, overlap " << 100.0 * overlap << "%" << endl;
+    cout << "Throughput " << gflops << " GFLOP/s, I/O " << ioMBps << " MB/s, result " << (verified ? "pass" : "FAIL") << " (C in " << pathC << ")" << endl;
+
+    const string path = "metrics_cpp/ooc_cpp.csv";
+    ofstream out(path, ios::out | ios::app);
+    if (out.tellp() == 0)
+        out << "size,tile,io,algorithm,blockSize,threads,time,compute_time,read_time,write_time,stall_time,read_bytes,write_bytes,"
+               "overlap,gflops,io_mbps,verified" << endl;
+    out << n << "," << T << "," << (cfg.useMmap ? "mmap" : "pread") << "," << algoName << "," << opt.bkSize << "," << omp_get_max_threads()
+        << "," << wall << "," << computeTime << "," << readTime << "," << writeTime << "," << stallTime << "," << (long long)readBytes
+        << "," << (long long)writeBytes << "," << overlap << "," << gflops << "," << ioMBps << "," << (verified ? "pass" : "fail") << endl;
+    cout << "Out-of-core results appended to " << path << endl;
+    return verified ? 0 : 1;
+}
+
+// Corre os algoritmos pedidos sobre operandos lidos de ficheiros .cpdm: A (M x K) e B (K x N) são mapeados sem
+// cópia quando possível; com pathC, C (M x N, double row-major) é escrito diretamente no ficheiro mapeado
+int RunFileInputs(const string &pathA, const string &pathB, const string &pathC, vector<string> algos) {
+    MappedMatrix fa, fb, fc;
+    if (!map_matrix_file(pathA, false, fa) || !map_matrix_file(pathB, false, fb)) {
+        cerr << "Error reading matrix file " << (fa.base == nullptr ? pathA : pathB) << endl;
+        unmap_matrix_file(fa);
+        return 1;
+    }
+    if (fa.h.cols != fb.h.rows) {
+        cerr << "Inner dimensions differ: A is " << fa.h.rows << "x" << fa.h.cols << ", B is " << fb.h.rows << "x" << fb.h.cols << endl;
+        unmap_matrix_file(fa);
+        unmap_matrix_file(fb);
+        return 1;
+    }
+    int M = (int)fa.h.rows, K = (int)fa.h.cols, N = (int)fb.h.cols;
+    vector<AlgoEntry> registry = algorithm_registry();
+    if (algos.empty())
+        algos = {"Simd"};
+    for (const string &name : algos) {
+        if (name != "Auto" && find_if(registry.begin(), registry.end(), [&](const AlgoEntry &e) { return e.name == name; }) == registry.end()) {
+            cerr << "Unknown algorithm: " << name << endl;
+            unmap_matrix_file(fa);
+            unmap_matrix_file(fb);
+            return 1;
+        }
+    }
+
+    GemmOperand A = matrix_operand(fa), B = matrix_operand(fb);
+    // Liberta as cópias convertidas e os mapeamentos dos operandos (caminho de erro e fim normal)
+    auto releaseInputs = [&] {
+        free(A.owned);
+        free(B.owned);
+        unmap_matrix_file(fa);
+        unmap_matrix_file(fb);
+    };
+    size_t subA = count_subnormals(fa), subB = count_subnormals(fb);
+    double *C;
+    int ldc = N;
+    fc.base = nullptr;
+    if (!pathC.empty()) {
+        if (!create_matrix_file(pathC, make_matrix_header(M, N, 0, LAYOUT_ROW_MAJOR, 0), fc)) {
+            cerr << "Error creating " << pathC << endl;
+            releaseInputs();
+            return 1;
+        }
+        C = (double *)fc.data;
+        ldc = (int)fc.h.ld;
+    } else {
+        C = alloc_aligned((size_t)M * N);
+    }
+    auto describe = [](const MappedMatrix &m, const GemmOperand &op, size_t sub) {
+        cout << m.h.rows << "x" << m.h.cols << " " << DTYPES[m.h.dtype] << " " << matrix_layout_name(m.h.layout)
+             << (op.zeroCopy ? " (mmap, zero copy)" : " (converted to double)") << ", " << sub << " subnormals" << endl;
+    };
+    cout << "A: ";
+    describe(fa, A, subA);
+    cout << "B: ";
+    describe(fb, B, subB);
+
+    const string path = "metrics_cpp/files_cpp.csv";
+    ofstream out(path, ios::out | ios::app);
+    if (out.tellp() == 0)
+        out << "algorithm,file_a,file_b,M,N,K,dtype_a,layout_a,dtype_b,layout_b,zero_copy,subnormals_a,subnormals_b,threads,"
+               "reps,time,min,stddev,mflops,L1,L2" << endl;
+    // Auto escolhe o caminho pela estrutura de A (gemm_auto), com operandos row-major: os guardados
+    // transpostos são copiados uma vez, fora da medição
+    const double *rowA = A.ptr, *rowB = B.ptr;
+    int ldRowA = A.ld, ldRowB = B.ld;
+    double *copyA = nullptr, *copyB = nullptr;
+    if (find(algos.begin(), algos.end(), "Auto") != algos.end()) {
+        if (A.trans == 'T') {
+            copyA = alloc_aligned((size_t)M * K);
+            transpose(K, M, A.ptr, A.ld, copyA, K);
+            rowA = copyA;
+            ldRowA = K;
+        }
+        if (B.trans == 'T') {
+            copyB = alloc_aligned((size_t)K * N);
+            transpose(N, K, B.ptr, B.ld, copyB, N);
+            rowB = copyB;
+            ldRowB = N;
+        }
+    }
+    CounterSample sample;
+    for (const string &name : algos) {
+        auto entry = find_if(registry.begin(), registry.end(), [&](const AlgoEntry &e) { return e.name == name; });
+        GemmOptions opt = registry_gemm_options(name, 0);
+        string chosen;
+        BenchStats st = RunBenchmark([&] {
+            double start = omp_get_wtime();
+            if (name == "Auto")
+                gemm_auto(M, N, K, rowA, ldRowA, rowB, ldRowB, C, ldc, &chosen);
+            else
+                gemm(A.trans, B.trans, M, N, K, 1.0, A.ptr, A.ld, B.ptr, B.ld, 0.0, C, ldc, opt);
+            return omp_get_wtime() - start;
+        }, &sample, name == "Auto" || !entry->baseline.empty() || name == "Strassen" || name == "Morton");
+        if (!chosen.empty())
+            cout << "Auto dispatch: " << chosen << endl;
+        double mflops = 2.0 * M * N * (double)K / (st.median * 1.0e6);
+        cout << setw(16) << name << "  time " << st.median << " s (min " << st.min << "), " << mflops << " MFlops" << endl;
+        out << name << "," << pathA << "," << pathB << "," << M << "," << N << "," << K << "," << DTYPES[fa.h.dtype] << ","
+            << matrix_layout_name(fa.h.layout) << "," << DTYPES[fb.h.dtype] << "," << matrix_layout_name(fb.h.layout) << ","
+            << (A.zeroCopy && B.zeroCopy ? 1 : 0) << "," << subA << "," << subB << "," << omp_get_max_threads() << "," << st.reps
+            << "," << st.median << "," << st.min << "," << st.stddev << "," << mflops << ","
+            << format_counter(sample.get("PAPI_L1_DCM"), false) << "," << format_counter(sample.get("PAPI_L2_DCM"), false) << endl;
+    }
+    cout << "Results appended to " << path << endl;
+
+    if (!pathC.empty()) {
+        msync(fc.base, fc.bytes, MS_SYNC);
+        unmap_matrix_file(fc);
+        cout << "C (" << M << "x" << N << ", double row-major) written to " << pathC << endl;
+    } else {
+        free(C);
+    }
+    free(copyA);
+    free(copyB);
+    releaseInputs();
+    return 0;
+}
+
+// Benchmark do lote: para cada n, count produtos n x n sobre entradas aleatórias (semente fixa) em blocos
+// contíguos, comparando o ciclo de chamadas a gemm() (uma região paralela por produto em LineExtParallel)
+// com o lote por descritores (kernel genérico e especializado) e com passos fixos.
+// speedup é contra PerCallParallel; max_error é a maior diferença para o produto de PerCall
+int RunBatchBenchmark(vector<int> sizes, int count) {
+    if (sizes.empty())
+        sizes = {4, 8, 16, 32, 64, 128};
+    const size_t MAX_BATCH_BYTES = (size_t)1 << 30;
+    string path = "metrics_cpp/batch_cpp.csv";
+    ofstream out(path, ios::out | ios::app);
+    if (out.tellp() == 0)
+        out << "algorithm,size,batch,kernel,threads,reps,time,min,stddev,matrices_per_s,mflops,speedup,max_error" << endl;
+    cout << setw(16) << "Algorithm" << setw(6) << "N" << setw(8) << "Batch" << setw(10) << "Kernel" << setw(14) << "Time (s)"
+         << setw(16) << "Matrices/s" << setw(12) << "MFlops" << setw(10) << "Speedup" << setw(14) << "Max error" << endl;
+
+    for (int n : sizes) {
+        size_t elems = (size_t)n * n;
+        int batch = (int)min((size_t)count, max((size_t)1, MAX_BATCH_BYTES / (4 * elems * sizeof(double))));
+        if (batch < count)
+            cout << "N=" << n << ": batch reduced to " << batch << " (1 GB limit)" << endl;
+        double *A = alloc_aligned(elems * batch), *B = alloc_aligned(elems * batch);
+        double *C = alloc_aligned(elems * batch), *ref = alloc_aligned(elems * batch);
+        srand(12345);
+        for (size_t i = 0; i < elems * batch; i++) {
+            A[i] = 2.0 * rand() / RAND_MAX - 1.0;
+            B[i] = 2.0 * rand() / RAND_MAX - 1.0;
+        }
+        vector<GemmBatchEntry> entries(batch);
+        for (int b = 0; b < batch; b++)
+            entries[b] = {n, n, n, A + b * elems, n, B + b * elems, n, C + b * elems, n};
+
+        struct Variant {
+            string name;
+            bool fixed;
+            function<void()> run;
+        };
+        bool specialized = small_gemm_kernel(n, n, n) != nullptr;
+        vector<Variant> variants = {
+            {"PerCall", false, [&] {
+                 for (int b = 0; b < batch; b++)
+                     gemm('N', 'N', n, n, n, 1.0, A + b * elems, n, B + b * elems, n, 0.0, ref + b * elems, n, GemmOptions(GEMM_LINE));
+             }},
+            {"PerCallParallel", false, [&] {
+                 for (int b = 0; b < batch; b++)
+                     gemm('N', 'N', n, n, n, 1.0, A + b * elems, n, B + b * elems, n, 0.0, C + b * elems, n, GemmOptions(GEMM_LINE_EXT_PARALLEL));
+             }},
+            {"BatchGeneric", false, [&] { gemm_batch(entries.data(), batch, 1.0, 0.0, false); }},
+            {"BatchPointers", specialized, [&] { gemm_batch(entries.data(), batch, 1.0, 0.0); }},
+            {"BatchStrided", specialized, [&] {
+                 gemm_batch_strided(n, n, n, 1.0, A, n, elems, B, n, elems, 0.0, C, n, elems, batch);
+             }},
+        };
+        double tBaseline = 0.0;
+        for (const Variant &v : variants) {
+            BenchStats st = RunBenchmark([&] {
+                double start = omp_get_wtime();
+                v.run();
+                return omp_get_wtime() - start;
+            });
+            if (v.name == "PerCallParallel")
+                tBaseline = st.median;
+            double err = v.name == "PerCall" ? 0.0 : max_abs_diff(C, ref, elems * batch);
+            double perSecond = batch / st.median;
+            double mflops = 2.0 * elems * n * batch / (st.median * 1.0e6);
+            double speedup = tBaseline > 0.0 ? tBaseline / st.median : NAN;
+            const char *kernel = v.fixed ? "fixed" : "generic";
+            cout << setw(16) << v.name << setw(6) << n << setw(8) << batch << setw(10) << kernel << setw(14) << st.median
+                 << setw(16) << perSecond << setw(12) << mflops << setw(10) << format_metric(speedup, false) << setw(14) << err << endl;
+            out << v.name << "," << n << "," << batch << "," << kernel << "," << omp_get_max_threads() << "," << st.reps << ","
+                << st.median << "," << st.min << "," << st.stddev << "," << perSecond << "," << mflops << ","
+                << format_metric(speedup, false) << "," << err << endl;
+            ResultRow row = {v.name, n, 0, batch, st, CounterSample(), speedup, NAN, omp_get_max_threads(), 0, 0, 0, "double", NAN, "", NAN, 1, NAN, NAN,
+                             2.0 * elems * n * batch};
+            AppendHistoryRow(path, row);
+        }
+        free(A);
+        free(B);
+        free(C);
+        free(ref);
+    }
+    cout << "Results appended to " << path << endl;
+    return 0;
+}
 
-    double start_time = omp_get_wtime();
-    for (int i = 0; i < m_ar; i++) {
-        for (int k = 0; k < m_ar; k++) {
-            double temp = matrixA[i * m_ar + k];
-            for (int j = 0; j < m_br; j++) {
-                matrixC[i * m_ar + j] += temp * matrixB[k * m_br + j];
-            }
+// Um caso do benchmark de epílogos: o mesmo epílogo fundido (gemm_fused) e não fundido (gemm em double seguido
+// de apply_epilogue, com um C temporário em double quando Out não é double). max_rel_diff compara as duas
+// saídas a partir do mesmo C inicial, relativo ao maior |C|; devolve false se exceder a tolerância
+template <typename Out, typename Epi>
+bool epilogue_case(const string &name, const Epi &epi, GemmAlgo algo, int n, int bs, const double *A, const double *B,
+                   const double *C0, ofstream &out) {
+    typedef typename ElemTraits<Out>::acc Store;
+    size_t elems = (size_t)n * n;
+    Out *Cf = alloc_aligned<Out>(elems), *Cu = alloc_aligned<Out>(elems);
+    double *scratch = is_same<Out, double>::value ? nullptr : alloc_aligned(elems);
+    auto reset = [&](Out *C) {
+        for (size_t i = 0; i < elems; i++)
+            C[i] = Out((Store)C0[i]);
+    };
+    GemmOptions opt(algo, bs);
+    bool parallel = algo == GEMM_BLOCK_PARALLEL || algo == GEMM_LINE_EXT_PARALLEL;
+    auto fused = [&] { gemm_fused(algo, n, n, n, A, n, B, n, Cf, n, epi, bs); };
+    auto unfused = [&] {
+        double *acc = scratch ? scratch : (double *)Cu;
+        if (Epi::useBeta && scratch) {
+            for (size_t i = 0; i < elems; i++)
+                scratch[i] = (double)(Store)Cu[i];
         }
+        gemm('N', 'N', n, n, n, epi.alpha, A, n, B, n, Epi::useBeta ? epi.beta : 0.0, acc, n, opt);
+        apply_epilogue(n, n, acc, n, Cu, n, epi.post(), parallel);
+    };
+
+    reset(Cf);
+    reset(Cu);
+    fused();
+    unfused();
+    double diff = 0.0, scale = 0.0;
+    for (size_t i = 0; i < elems; i++) {
+        diff = max(diff, fabs((double)(Store)Cf[i] - (double)(Store)Cu[i]));
+        scale = max(scale, fabs((double)(Store)Cu[i]));
     }
-    double elapsed = omp_get_wtime() - start_time;
+    double relDiff = scale > 0.0 ? diff / scale : diff;
+    // Arredondamento da saída (um ulp de Out de cada lado) mais a reassociação de alpha na soma em double
+    double tol = 2.0 * ElemTraits<Out>::unit_roundoff() + 4.0 * n * ldexp(1.0, -53);
+    bool ok = relDiff <= tol;
 
-    cout << "Result matrix (first row): ";
-    for (int j = 0; j < min(10, m_br); j++)
-        cout << matrixC[j] << " ";
-    cout << endl;
+    auto timed = [](const function<void()> &run) {
+        return RunBenchmark([&] {
+            double start = omp_get_wtime();
+            run();
+            return omp_get_wtime() - start;
+        });
+    };
+    reset(Cu);
+    BenchStats su = timed(unfused);
+    reset(Cf);
+    BenchStats sf = timed(fused);
 
-    clean_matrices(matrixA, matrixB, matrixC);
-    return elapsed;
+    double flops = 2.0 * (double)n * n * n;
+    const char *dtype = ElemTraits<Out>::name();
+    for (int f = 0; f < 2; f++) {
+        const BenchStats &st = f ? sf : su;
+        double speedup = f ? su.median / sf.median : NAN;
+        cout << setw(16) << gemm_algo_name(algo) << setw(6) << n << setw(12) << name << setw(8) << dtype << setw(9)
+             << (f ? "fused" : "unfused") << setw(14) << st.median << setw(12) << flops / (st.median * 1.0e6) << setw(10)
+             << format_metric(speedup, false) << setw(14) << relDiff << (ok ? "" : "  FAIL") << endl;
+        out << gemm_algo_name(algo) << "," << n << "," << bs << "," << name << "," << dtype << "," << (f ? "fused" : "unfused") << ","
+            << omp_get_max_threads() << "," << st.reps << "," << st.median << "," << st.min << "," << st.stddev << ","
+            << flops / (st.median * 1.0e6) << "," << format_metric(speedup, false) << "," << relDiff << "," << (ok ? "pass" : "fail") << endl;
+        ResultRow row = {string(gemm_algo_name(algo)) + "_" + name + (f ? "_fused" : "_unfused"), n, bs, 0, st, CounterSample(), speedup, NAN,
+                         omp_get_max_threads(), 0, 0, 0, dtype, NAN, ok ? "pass" : "fail", NAN, 1, NAN, NAN, 0.0};
+        AppendHistoryRow("metrics_cpp/epilogue_cpp.csv", row);
+    }
+    free(Cf);
+    free(Cu);
+    free(scratch);
+    return ok;
 }
 
-// Multiplicação por linha paralela externa 
-double OnMultLineExtParallel(int m_ar, int m_br) {
-    double *matrixA, *matrixB, *matrixC;
-    matrixA = (double *)malloc((m_ar * m_ar) * sizeof(double));
-    matrixB = (double *)malloc((m_ar * m_ar) * sizeof(double));
-    matrixC = (double *)malloc((m_ar * m_ar) * sizeof(double));
-    initialize_matrices(matrixA, matrixB, matrixC, m_ar, m_br);
+// Benchmark dos epílogos fundidos: para cada algoritmo (Line, Block, BlockParallel por omissão) e n, cada epílogo
+// pedido (scale = alpha/beta, bias_relu, bias_gelu, clamp e relu_float/relu_bf16/relu_fp16 com conversão da
+// saída) fundido e em duas passagens, sobre entradas aleatórias (semente fixa). Resultados em epilogue_cpp.csv,
+// com o speedup do fundido sobre o não fundido; devolve 1 se alguma saída divergir
+int RunEpilogueBenchmark(vector<string> algos, vector<int> sizes, vector<string> epilogues) {
+    const vector<string> ALL_EPILOGUES = {"scale", "bias_relu", "bias_gelu", "clamp", "relu_float", "relu_bf16", "relu_fp16"};
+    if (algos.empty())
+        algos = {"Line", "Block", "BlockParallel"};
+    if (sizes.empty())
+        sizes = {1024, 2048};
+    if (epilogues.empty() || epilogues[0] == "all")
+        epilogues = ALL_EPILOGUES;
+    for (const string &e : epilogues) {
+        if (find(ALL_EPILOGUES.begin(), ALL_EPILOGUES.end(), e) == ALL_EPILOGUES.end()) {
+            cerr << "Unknown epilogue: " << e << endl;
+            return 1;
+        }
+    }
+    vector<GemmAlgo> kernels;
+    for (const string &name : algos) {
+        GemmAlgo algo;
+        if (!gemm_algo_from_name(name, algo) ||
+            (algo != GEMM_LINE && algo != GEMM_LINE_EXT_PARALLEL && algo != GEMM_BLOCK && algo != GEMM_BLOCK_PARALLEL)) {
+            cerr << "No fused epilogue for algorithm: " << name << " (Line, LineExtParallel, Block, BlockParallel)" << endl;
+            return 1;
+        }
+        kernels.push_back(algo);
+    }
+    int bs = globalSweep.blockSizes.empty() || globalSweep.blockSizes[0] <= 0 ? globalBlockSize : globalSweep.blockSizes[0];
 
-    double start_time = omp_get_wtime();
-#pragma omp parallel for
-    for (int i = 0; i < m_ar; i++) {
-        for (int k = 0; k < m_ar; k++) {
-            double temp = matrixA[i * m_ar + k];
-            for (int j = 0; j < m_br; j++) {
-                matrixC[i * m_ar + j] += temp * matrixB[k * m_br + j];
+    string path = "metrics_cpp/epilogue_cpp.csv";
+    ofstream out(path, ios::out | ios::app);
+    if (out.tellp() == 0)
+        out << "algorithm,size,blockSize,epilogue,dtype,mode,threads,reps,time,min,stddev,mflops,speedup,max_rel_diff,verified" << endl;
+    cout << setw(16) << "Algorithm" << setw(6) << "N" << setw(12) << "Epilogue" << setw(8) << "Dtype" << setw(9) << "Mode"
+         << setw(14) << "Time (s)" << setw(12) << "MFlops" << setw(10) << "Speedup" << setw(14) << "Max rel diff" << endl;
+
+    bool ok = true;
+    for (int n : sizes) {
+        size_t elems = (size_t)n * n;
+        double *A = alloc_aligned(elems), *B = alloc_aligned(elems), *C0 = alloc_aligned(elems);
+        vector<double> rowBias(n), colBias(n);
+        srand(12345);
+        for (size_t i = 0; i < elems; i++) {
+            A[i] = 2.0 * rand() / RAND_MAX - 1.0;
+            B[i] = 2.0 * rand() / RAND_MAX - 1.0;
+            C0[i] = 2.0 * rand() / RAND_MAX - 1.0;
+        }
+        for (int i = 0; i < n; i++) {
+            rowBias[i] = 2.0 * rand() / RAND_MAX - 1.0;
+            colBias[i] = 2.0 * rand() / RAND_MAX - 1.0;
+        }
+        // Os produtos de entradas em [-1, 1] têm desvio padrão ~sqrt(n / 9): o clamp corta a cauda acima de 1 desvio
+        double limit = sqrt(n / 9.0);
+        BiasRow br = {rowBias.data()};
+        BiasCol bc = {colBias.data()};
+        for (GemmAlgo algo : kernels) {
+            for (const string &e : epilogues) {
+                if (e == "scale")
+                    ok = epilogue_case<double>(e, make_epilogue<BiasNone, ActNone, true>(0.5, 2.0, BiasNone(), ActNone()), algo, n, bs, A, B, C0, out) && ok;
+                else if (e == "bias_relu")
+                    ok = epilogue_case<double>(e, make_epilogue(1.0, 0.0, br, ActRelu()), algo, n, bs, A, B, C0, out) && ok;
+                else if (e == "bias_gelu")
+                    ok = epilogue_case<double>(e, make_epilogue(1.0, 0.0, bc, ActGelu()), algo, n, bs, A, B, C0, out) && ok;
+                else if (e == "clamp")
+                    ok = epilogue_case<double>(e, make_epilogue(1.0, 0.0, BiasNone(), ActClamp{-limit, limit}), algo, n, bs, A, B, C0, out) && ok;
+                else if (e == "relu_float")
+                    ok = epilogue_case<float>(e, make_epilogue(1.0, 0.0, br, ActRelu()), algo, n, bs, A, B, C0, out) && ok;
+                else if (e == "relu_bf16")
+                    ok = epilogue_case<bf16>(e, make_epilogue(1.0, 0.0, br, ActRelu()), algo, n, bs, A, B, C0, out) && ok;
+                else
+                    ok = epilogue_case<fp16>(e, make_epilogue(1.0, 0.0, br, ActRelu()), algo, n, bs, A, B, C0, out) && ok;
             }
         }
+        free(A);
+        free(B);
+        free(C0);
     }
-    double elapsed = omp_get_wtime() - start_time;
+    cout << "Results appended to " << path << endl;
+    return ok ? 0 : 1;
+}
 
-    cout << "Result matrix (first row): ";
-    for (int j = 0; j < min(10, m_br); j++)
-        cout << matrixC[j] << " ";
-    cout << endl;
+// Caminhos esparsos e estruturados contra o denso: para cada n, A n x n esparsa (uniforme e em blocos 4x4
+// densos) a cada densidade, triangular inferior e simétrica, sempre com B n x n densa. Cada linha do CSV dá
+// MFlops úteis (2 nnz(A) n, ou n^2 (n + 1) no SYRK) e o equivalente denso (2 n^3); o speedup é contra o
+// kernel por linha (Line) na mesma entrada e max_error contra o produto denso com o motor SIMD
+int RunStructured(vector<int> sizes, vector<double> densities) {
+    if (sizes.empty())
+        sizes = {1024};
+    if (densities.empty())
+        densities = {0.01, 0.05, 0.1};
+    int threads = omp_get_max_threads();
+    const string path = "metrics_cpp/structured_cpp.csv";
+    ofstream out(path, ios::out | ios::app);
+    if (out.tellp() == 0)
+        out << "algorithm,structure,size,density,nnz,threads,reps,time,min,stddev,useful_mflops,dense_mflops,speedup,max_error" << endl;
+    cout << setw(10) << "Algorithm" << setw(14) << "Structure" << setw(7) << "N" << setw(11) << "Density" << setw(12) << "Time (s)"
+         << setw(14) << "Useful MF/s" << setw(14) << "Dense MF/s" << setw(10) << "Speedup" << setw(12) << "Max error" << endl;
 
-    clean_matrices(matrixA, matrixB, matrixC);
-    return elapsed;
-}
+    for (int n : sizes) {
+        size_t count = (size_t)n * n;
+        double *A = alloc_aligned(count), *B = alloc_aligned(count), *C = alloc_aligned(count), *ref = alloc_aligned(count);
+        srand(12345);
+        for (size_t i = 0; i < count; i++)
+            B[i] = 2.0 * rand() / RAND_MAX - 1.0;
 
-// Multiplicação por linha paralela interna
-double OnMultLineIntParallel(int m_ar, int m_br) {
-    double *matrixA, *matrixB, *matrixC;
-    matrixA = (double *)malloc((m_ar * m_ar) * sizeof(double));
-    matrixB = (double *)malloc((m_ar * m_ar) * sizeof(double));
-    matrixC = (double *)malloc((m_ar * m_ar) * sizeof(double));
-    initialize_matrices(matrixA, matrixB, matrixC, m_ar, m_br);
+        // Corre as variantes de um caso (ref já calculada); a primeira (Line) dá a referência do speedup
+        auto run_case = [&](const string &structure, double density, size_t nnz, double usefulOps,
+                            const vector<pair<string, function<void()>>> &variants) {
+            double tLine = 0.0;
+            for (auto &v : variants) {
+                BenchStats st = RunBenchmark([&] {
+                    double start = omp_get_wtime();
+                    v.second();
+                    return omp_get_wtime() - start;
+                });
+                if (v.first == "Line")
+                    tLine = st.median;
+                PerfMetrics pm = computeMetrics(n, tLine, st.median, threads, usefulOps);
+                double dense = 2.0 * n * (double)n * n / (st.median * 1.0e6);
+                double err = max_abs_diff(C, ref, count);
+                cout << setw(10) << v.first << setw(14) << structure << setw(7) << n << setw(11) << setprecision(4) << density << setprecision(6) << setw(12) << st.median
+                     << setw(14) << pm.mflops << setw(14) << dense << setw(10) << pm.speedup << setw(12) << err << endl;
+                out << v.first << "," << structure << "," << n << "," << density << "," << nnz << "," << threads << "," << st.reps << ","
+                    << st.median << "," << st.min << "," << st.stddev << "," << pm.mflops << "," << dense << "," << pm.speedup << "," << err << endl;
+                // No histórico o caso entra no nome (kernel_estrutura_densidade) e mflops são os úteis
+                ostringstream name;
+                name << v.first << "_" << structure << "_" << setprecision(3) << density;
+                ResultRow row = {name.str(), n, 0, 0, st, CounterSample(), pm.speedup, NAN, threads, 0, 0, 0, "double", NAN, "", NAN, 1, NAN, NAN,
+                                 usefulOps};
+                AppendHistoryRow(path, row);
+            }
+        };
+        auto dense_variants = [&]() -> vector<pair<string, function<void()>>> {
+            return {
+                {"Line", [&] { gemm('N', 'N', n, n, n, 1.0, A, n, B, n, 0.0, C, n, GemmOptions(GEMM_LINE)); }},
+                {"Dense", [&] { gemm_rows_parallel(n, n, n, 1.0, A, n, B, n, 0.0, C, n); }},
+            };
+        };
 
-    double start_time = omp_get_wtime();
-#pragma omp parallel
-    {
-        for (int i = 0; i < m_ar; i++) {
-            for (int k = 0; k < m_ar; k++) {
-                double temp = matrixA[i * m_ar + k];
-#pragma omp for
-                for (int j = 0; j < m_br; j++) {
-                    matrixC[i * m_ar + j] += temp * matrixB[k * m_br + j];
+        for (int blocked = 0; blocked < 2; blocked++) {
+            for (double d : densities) {
+                fill(A, A + count, 0.0);
+                if (blocked) {
+                    for (int i0 = 0; i0 < n; i0 += BCSR_BLOCK)
+                        for (int k0 = 0; k0 < n; k0 += BCSR_BLOCK)
+                            if ((double)rand() / RAND_MAX < d)
+                                for (int i = i0; i < min(n, i0 + BCSR_BLOCK); i++)
+                                    for (int k = k0; k < min(n, k0 + BCSR_BLOCK); k++)
+                                        A[(size_t)i * n + k] = 2.0 * rand() / RAND_MAX - 1.0;
+                } else {
+                    for (size_t i = 0; i < count; i++)
+                        if ((double)rand() / RAND_MAX < d)
+                            A[i] = 2.0 * rand() / RAND_MAX - 1.0;
                 }
+                // Os formatos esparsos são construídos fora da medição, como operandos já guardados assim
+                CsrMatrix csr = csr_from_dense(n, n, A, n);
+                BcsrMatrix bcsr = bcsr_from_dense(n, n, A, n, BCSR_BLOCK, BCSR_BLOCK);
+                size_t nnz = csr.val.size();
+                auto variants = dense_variants();
+                variants.push_back({"CSR", [&] { spmm_csr(csr, n, 1.0, B, n, 0.0, C, n); }});
+                variants.push_back({"BCSR", [&] { spmm_bcsr(bcsr, n, 1.0, B, n, 0.0, C, n); }});
+                variants.push_back({"Auto", [&] { gemm_auto(n, n, n, A, n, B, n, C, n); }});
+                gemm_rows_parallel(n, n, n, 1.0, A, n, B, n, 0.0, ref, n);
+                run_case(blocked ? "sparse-4x4" : "sparse", (double)nnz / count, nnz, 2.0 * nnz * n, variants);
             }
         }
-    }
-    double elapsed = omp_get_wtime() - start_time;
 
-    cout << "Result matrix (first row): ";
-    for (int j = 0; j < min(10, m_br); j++)
-        cout << matrixC[j] << " ";
-    cout << endl;
+        // Triangular inferior e simétrica (só o triângulo inferior é lido por TRMM/SYMM)
+        for (int i = 0; i < n; i++)
+            for (int k = 0; k < n; k++)
+                A[(size_t)i * n + k] = k <= i ? 2.0 * rand() / RAND_MAX - 1.0 : 0.0;
+        size_t triangle = (size_t)n * (n + 1) / 2;
+        auto variants = dense_variants();
+        variants.push_back({"TRMM", [&] { trmm('L', n, n, 1.0, A, n, B, n, 0.0, C, n); }});
+        variants.push_back({"Auto", [&] { gemm_auto(n, n, n, A, n, B, n, C, n); }});
+        gemm_rows_parallel(n, n, n, 1.0, A, n, B, n, 0.0, ref, n);
+        run_case("lower", (double)triangle / count, triangle, 2.0 * triangle * n, variants);
 
-    clean_matrices(matrixA, matrixB, matrixC);
-    return elapsed;
+        for (int i = 0; i < n; i++)
+            for (int k = i + 1; k < n; k++)
+                A[(size_t)i * n + k] = A[(size_t)k * n + i];
+        variants = dense_variants();
+        variants.push_back({"SYMM", [&] { symm(n, n, 1.0, A, n, B, n, 0.0, C, n); }});
+        gemm_rows_parallel(n, n, n, 1.0, A, n, B, n, 0.0, ref, n);
+        run_case("symmetric", 1.0, count, 2.0 * n * (double)count, variants);
+
+        // SYRK: C = B * B^T (trabalho útil: as n (n + 1) / 2 entradas distintas de C), contra B^T explícita
+        double *Bt = alloc_aligned(count);
+        transpose(n, n, B, n, Bt, n);
+        gemm_rows_parallel(n, n, n, 1.0, B, n, Bt, n, 0.0, ref, n);
+        run_case("A*A^T", 1.0, count, (double)n * n * (n + 1), {
+            {"Line", [&] { gemm('N', 'N', n, n, n, 1.0, B, n, Bt, n, 0.0, C, n, GemmOptions(GEMM_LINE)); }},
+            {"Dense", [&] { gemm_rows_parallel(n, n, n, 1.0, B, n, Bt, n, 0.0, C, n); }},
+            {"SYRK", [&] { syrk(n, n, 1.0, B, n, 0.0, C, n); }},
+        });
+        free(Bt);
+        free(A);
+        free(B);
+        free(C);
+        free(ref);
+    }
+    cout << "Results appended to " << path << endl;
+    return 0;
 }
 
-// Multiplicação em bloco
-double OnMultBlock(int m_ar, int m_br, int bkSize) {
-    double *matrixA, *matrixB, *matrixC;
-    matrixA = (double *)malloc((m_ar * m_ar) * sizeof(double));
-    matrixB = (double *)malloc((m_ar * m_ar) * sizeof(double));
-    matrixC = (double *)malloc((m_ar * m_ar) * sizeof(double));
-    initialize_matrices(matrixA, matrixB, matrixC, m_ar, m_br);
+// Gerador de carga em malha aberta para GemmService: para cada taxa (pedidos/s), 'requests' chegadas de
+// Poisson (semente fixa) com tamanhos sorteados de 'sizes', independentes das respostas. A latência conta
+// desde a chegada prevista e não desde a submissão, para que atrasos do gerador não escondam a fila.
+// Um pedido que encontra a fila cheia ou o seu buffer de C ainda em uso é rejeitado (não entra nos percentis).
+int RunServiceLoad(vector<double> rates, vector<int> sizes, int workers, int maxBatch, int requests) {
+    if (sizes.empty())
+        sizes = {8, 16, 32, 64, 128};
+    if (rates.empty())
+        rates = {1000, 10000, 100000};
+    if (workers <= 0)
+        workers = max(1, (int)thread::hardware_concurrency());
+    int maxN = *max_element(sizes.begin(), sizes.end());
+    size_t maxElems = (size_t)maxN * maxN;
+    int slots = (int)max((size_t)16, min((size_t)1024, ((size_t)512 << 20) / (maxElems * sizeof(double))));
 
-    double start_time = omp_get_wtime();
-    for (int iBlock = 0; iBlock < m_ar; iBlock += bkSize) {
-        for (int kBlock = 0; kBlock < m_ar; kBlock += bkSize) {
-            for (int jBlock = 0; jBlock < m_br; jBlock += bkSize) {
-                int iMax = min(iBlock + bkSize, m_ar);
-                int kMax = min(kBlock + bkSize, m_ar);
-                int jMax = min(jBlock + bkSize, m_br);
-                for (int i = iBlock; i < iMax; i++) {
-                    for (int k = kBlock; k < kMax; k++) {
-                        double temp = matrixA[i * m_ar + k];
-                        for (int j = jBlock; j < jMax; j++) {
-                            matrixC[i * m_br + j] += temp * matrixB[k * m_br + j];
-                        }
-                    }
-                }
-            }
+    // Um par A/B por tamanho, partilhado (só leitura) por todos os pedidos; C tem um buffer por slot
+    map<int, pair<double *, double *>> operands;
+    srand(12345);
+    for (int n : sizes) {
+        if (operands.count(n))
+            continue;
+        double *A = alloc_aligned((size_t)n * n), *B = alloc_aligned((size_t)n * n);
+        for (size_t i = 0; i < (size_t)n * n; i++) {
+            A[i] = 2.0 * rand() / RAND_MAX - 1.0;
+            B[i] = 2.0 * rand() / RAND_MAX - 1.0;
         }
+        operands[n] = {A, B};
     }
-    double elapsed = omp_get_wtime() - start_time;
+    double *Cbuf = alloc_aligned(maxElems * slots);
+    GemmService service(workers, maxBatch, 2 * slots);
 
-    cout << "Result matrix (first row): ";
-    for (int j = 0; j < min(10, m_br); j++)
-        cout << matrixC[j] << " ";
-    cout << endl;
+    // Autoteste com futures: um pedido por tamanho contra gemm() com o kernel por linha
+    bool selfTest = true;
+    for (int n : sizes) {
+        double *ref = alloc_aligned((size_t)n * n);
+        gemm('N', 'N', n, n, n, 1.0, operands[n].first, n, operands[n].second, n, 0.0, ref, n, GemmOptions(GEMM_LINE));
+        service.submit(n, n, n, operands[n].first, n, operands[n].second, n, Cbuf, n).wait();
+        if (max_abs_diff(Cbuf, ref, (size_t)n * n) > 1e-12 * n)
+            selfTest = false;
+        free(ref);
+    }
+    cout << "GEMM service: " << workers << " workers, batches up to " << maxBatch << ", queue " << 2 * slots
+         << ", self-test " << (selfTest ? "passed" : "FAILED") << endl;
 
-    clean_matrices(matrixA, matrixB, matrixC);
-    return elapsed;
-}
+    const string path = "metrics_cpp/service_cpp.csv";
+    ofstream out(path, ios::out | ios::app);
+    if (out.tellp() == 0)
+        out << "rate,sizes,workers,max_batch,requests,completed,rejected,throughput,mean,p50,p99,p999,max,coalesced_fraction" << endl;
+    string sizeList;
+    for (int n : sizes)
+        sizeList += (sizeList.empty() ? "" : ";") + to_string(n);
+    cout << setw(10) << "Rate" << setw(10) << "Done" << setw(10) << "Rejected" << setw(14) << "Throughput" << setw(12) << "p50 (us)"
+         << setw(12) << "p99 (us)" << setw(12) << "p999 (us)" << setw(12) << "max (us)" << setw(11) << "Coalesced" << endl;
 
-// Funções PAPI para métricas e performance evaluation
+    vector<GemmTask> tasks(slots);
+    vector<atomic<bool>> busy(slots);
+    vector<double> arrival(requests), finish(requests), latency(requests);
+    for (double rate : rates) {
+        for (auto &b : busy)
+            b.store(false);
+        fill(latency.begin(), latency.end(), -1.0);
+        vector<int> chosen(requests);
+        double t = 0.0;
+        for (int i = 0; i < requests; i++) {
+            t += -log(1.0 - (double)rand() / ((double)RAND_MAX + 1.0)) / rate;
+            arrival[i] = t;
+            chosen[i] = sizes[rand() % sizes.size()];
+        }
+        atomic<long> completed(0);
+        long accepted = 0, rejected = 0;
+        long executed0 = service.executed(), coalesced0 = service.coalesced();
+        double start = omp_get_wtime() + 0.01;
+        for (int i = 0; i < requests; i++) {
+            double target = start + arrival[i];
+            double now;
+            while ((now = omp_get_wtime()) < target) {
+                if (target - now > 200e-6)
+                    this_thread::sleep_for(chrono::microseconds((long)(min(target - now, 1.0) * 1e6) - 100));
+            }
+            int slot = i % slots;
+            if (busy[slot].load(memory_order_acquire)) {
+                rejected++;
+                continue;
+            }
+            busy[slot].store(true, memory_order_relaxed);
+            int n = chosen[i];
+            GemmTask &task = tasks[slot];
+            task = {n, n, n, operands[n].first, n, operands[n].second, n, Cbuf + (size_t)slot * maxElems, n, nullptr};
+            task.done = [&, i, slot] {
+                double end = omp_get_wtime();
+                finish[i] = end;
+                latency[i] = end - (start + arrival[i]);
+                busy[slot].store(false, memory_order_release);
+                completed.fetch_add(1);
+            };
+            if (!service.submit(&task)) {
+                busy[slot].store(false, memory_order_relaxed);
+                rejected++;
+                continue;
+            }
+            accepted++;
+        }
+        while (completed.load() < accepted)
+            this_thread::sleep_for(chrono::microseconds(200));
 
-void handle_error(int retval) {
-    printf("PAPI error %d: %s\n", retval, PAPI_strerror(retval));
-    exit(1);
-}
+        vector<double> done;
+        double last = start;
+        for (int i = 0; i < requests; i++) {
+            if (latency[i] >= 0.0) {
+                done.push_back(latency[i] * 1e6);
+                last = max(last, finish[i]);
+            }
+        }
+        sort(done.begin(), done.end());
+        double mean = 0.0;
+        for (double l : done)
+            mean += l / done.size();
+        double throughput = done.size() / (last - start);
+        long executed = service.executed() - executed0;
+        double coalesced = executed > 0 ? (double)(service.coalesced() - coalesced0) / executed : 0.0;
+        double p50 = done.empty() ? NAN : quantile_sorted(done, 0.5), p99 = done.empty() ? NAN : quantile_sorted(done, 0.99);
+        double p999 = done.empty() ? NAN : quantile_sorted(done, 0.999), worst = done.empty() ? NAN : done.back();
+        cout << setw(10) << rate << setw(10) << done.size() << setw(10) << rejected << setw(14) << throughput << setw(12) << p50
+             << setw(12) << p99 << setw(12) << p999 << setw(12) << worst << setw(11) << coalesced << endl;
+        out << rate << "," << sizeList << "," << workers << "," << maxBatch << "," << requests << "," << done.size() << ","
+            << rejected << "," << throughput << "," << mean << "," << format_metric(p50, false) << "," << format_metric(p99, false)
+            << "," << format_metric(p999, false) << "," << format_metric(worst, false) << "," << coalesced << endl;
+    }
+    cout << "Latencies in microseconds; results appended to " << path << endl;
 
-void init_papi() {
-    int retval = PAPI_library_init(PAPI_VER_CURRENT);
-    if (retval != PAPI_VER_CURRENT && retval < 0) {
-        printf("PAPI library version mismatch!\n");
-        exit(1);
+    free(Cbuf);
+    for (auto &op : operands) {
+        free(op.second.first);
+        free(op.second.second);
     }
-    if (retval < 0)
-        handle_error(retval);
-    cout << "PAPI Version Number: MAJOR: " << PAPI_VERSION_MAJOR(retval)
-         << " MINOR: " << PAPI_VERSION_MINOR(retval)
-         << " REVISION: " << PAPI_VERSION_REVISION(retval) << "\n";
+    return selfTest ? 0 : 1;
 }
 
-// Para multiplicação de matrizes NxN consideramos ~2*N^3 operações (N^3 mul + N^3 add)
-// MFlops = (2*N^3) / (tempo * 1e6)
-// Speedup = (tempo_seq) / (tempo_paralelo)
-// Eficiência = Speedup / (#threads)
-
-struct PerfMetrics {
-    double mflops;
-    double speedup;
-    double efficiency;
+#ifdef USE_MPI
+// MPI_Init/MPI_Finalize à volta de main; só a thread principal faz chamadas MPI
+struct MpiSession {
+    int rank = 0, size = 1;
+    MpiSession(int *argc, char ***argv) {
+        int provided;
+        MPI_Init_thread(argc, argv, MPI_THREAD_FUNNELED, &provided);
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        MPI_Comm_size(MPI_COMM_WORLD, &size);
+    }
+    ~MpiSession() { MPI_Finalize(); }
 };
 
-PerfMetrics computeMetrics(int N, double timeSerial, double timeParallel, int threads) {
-    PerfMetrics pm;
-    double ops = 2.0 * (double)N * (double)N * (double)N;
-    pm.mflops = (ops / (timeParallel * 1.0e6));
-    pm.speedup = (timeSerial / timeParallel);
-    pm.efficiency = pm.speedup / (double)threads;
-    return pm;
+// Distribuição por blocos de n índices por 'parts' processos; os primeiros n % parts ficam com mais um
+void block_range(int n, int parts, int idx, int &start, int &len) {
+    int base = n / parts, extra = n % parts;
+    start = idx * base + min(idx, extra);
+    len = base + (idx < extra ? 1 : 0);
 }
 
-// Função de teste para medir MFlops, Speedup e Eficiência comparando a versão sequencial e a versão paralela
-void TestParallelPerformance(int N, double (*seqFunc)(int, int), double (*parFunc)(int, int), const string &algName) {
-    int threads = omp_get_max_threads();
-    double tSeq = seqFunc(N, N);
-    double tPar = parFunc(N, N);
-    PerfMetrics pm = computeMetrics(N, tSeq, tPar, threads);
-
-    cout << "\n[" << algName << "] N=" << N
-         << " Threads=" << threads << "\n";
-    cout << "  Sequential time = " << tSeq << " s\n";
-    cout << "  Parallel time   = " << tPar << " s\n";
-    cout << "  Speedup          = " << pm.speedup << "\n";
-    cout << "  Efficiency       = " << pm.efficiency << "\n";
-    cout << "  MFlops           = " << pm.mflops << "\n\n";
+int block_owner(int n, int parts, int i) {
+    int base = n / parts, extra = n % parts;
+    return i < extra * (base + 1) ? i / (base + 1) : extra + (i - extra * (base + 1)) / base;
 }
 
-double RunAutomatedTests(int EventSet, bool papi_enabled) {
-    int ret;
-    long long values[2] = {0, 0};
-    int threads = omp_get_max_threads();
-    
-    ofstream outfile("metrics_cpp/results_cpp.csv", ios::out);
-    if (outfile.is_open()) {
-        outfile << "algorithm,size,blockSize,numBlocks,time,L1,L2,mflops,speedup,efficiency,threads\n";
-        outfile.close();
-    }
+// Painel k..k+width de A (coluna de processos ownerCol) e de B (linha ownerRow); nunca atravessa
+// a fronteira entre dois donos, por isso a largura pode ser menor que --mpi-panel
+struct SummaPanel {
+    int k, width, ownerCol, ownerRow;
+};
 
-    vector<int> sizes1;
-    for (int n = 600; n <= 3000; n += 400) {
-        sizes1.push_back(n);
-    }
-    vector<int> sizes2;
-    for (int n = 4096; n <= 10240; n += 2048) {
-        sizes2.push_back(n);
-    }
-    vector<int> blockSizes = {128, 256, 512};
-    
-    auto WriteResult = [&](const string &algorithm, int size, int blockSize, int numBlocks, double time, long long L1, long long L2, double mflops = 0.0, double speedup = 0.0, double efficiency = 0.0) {
-        ofstream outfile("metrics_cpp/results_cpp.csv", ios::out | ios::app);
-        if (outfile.is_open()) {
-            outfile << algorithm << "," << size << "," << blockSize << "," << numBlocks << "," << time << "," << L1 << "," << L2 << "," << mflops << "," << speedup << "," << efficiency << "," << threads << "\n";
-            outfile.close();
-        }
-    };
-    
-    for (int n : sizes1) {
-        // Standard
-        if (papi_enabled) {
-            ret = PAPI_start(EventSet);
-            if (ret != PAPI_OK) cout << "ERROR: Start PAPI" << endl;
-        }
-        double t = OnMult(n, n);
-        if (papi_enabled) {
-            ret = PAPI_stop(EventSet, values);
-            if (ret != PAPI_OK) cout << "ERROR: Stop PAPI" << endl;
-            ret = PAPI_reset(EventSet);
-            if (ret != PAPI_OK) cout << "ERROR: Reset PAPI" << endl;
-        }
-        double ops = 2.0 * (double)n * (double)n * (double)n;
-        double mflops = (ops / (t * 1.0e6));
-        WriteResult("Standard", n, 0, 0, t, values[0], values[1], mflops, 1.0, 1.0);
+// Tempo com 1 processo para o mesmo algoritmo/N/painel numa execução anterior (CSV em 'path'), 0 se não houver
+double mpi_baseline_time(const string &path, const string &algorithm, int size, int panel) {
+    ifstream in(path);
+    string line;
+    if (!getline(in, line))
+        return 0.0;
+    vector<string> header = parse_string_list(line);
+    auto column = [&](const string &name) { return (int)(find(header.begin(), header.end(), name) - header.begin()); };
+    int cAlgo = column("algorithm"), cSize = column("size"), cBlock = column("blockSize"), cTime = column("time"), cRanks = column("ranks");
+    if (cRanks >= (int)header.size())
+        return 0.0;
+    double t1 = 0.0;
+    while (getline(in, line)) {
+        vector<string> f;
+        stringstream ss(line);
+        string cell;
+        while (getline(ss, cell, ','))
+            f.push_back(cell);
+        if ((int)f.size() > cRanks && f[cAlgo] == algorithm && atoi(f[cSize].c_str()) == size &&
+            atoi(f[cBlock].c_str()) == panel && atoi(f[cRanks].c_str()) == 1)
+            t1 = atof(f[cTime].c_str());
     }
+    return t1;
+}
 
-    for (int n : sizes1) {
-        if (papi_enabled) {
-            ret = PAPI_start(EventSet);
-            if (ret != PAPI_OK) cout << "ERROR: Start PAPI" << endl;
-        }
-        double t = OnMultLine(n, n);
-        if (papi_enabled) {
-            ret = PAPI_stop(EventSet, values);
-            if (ret != PAPI_OK) cout << "ERROR: Stop PAPI" << endl;
-            ret = PAPI_reset(EventSet);
-            if (ret != PAPI_OK) cout << "ERROR: Reset PAPI" << endl;
-        }
-        double ops = 2.0 * (double)n * (double)n * (double)n;
-        double mflops = (ops / (t * 1.0e6));
-        WriteResult("Line", n, 0, 0, t, values[0], values[1], mflops, 1.0, 1.0);
+// SUMMA numa grelha pr x pc (MPI_Dims_create) de processos: cada um guarda o bloco (i, j) de A, B e C.
+// Em cada passo o dono do painel de A difunde-o pela linha e o dono do painel de B pela coluna, com
+// MPI_Ibcast; o passo seguinte é difundido enquanto o atual é multiplicado pelo kernel local (duplo buffer).
+// comm_time é só a espera não sobreposta. Entradas A(i,k) = (i+1)(k+1), B(k,j) = k+1+j têm produto
+// conhecido, verificado em cada processo. Com ranks = 1 no mesmo ficheiro, speedup = T1 / Tp
+int RunSumma(vector<int> sizes, const string &kernel, int panel) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    GemmAlgo algo;
+    if (!gemm_algo_from_name(kernel, algo)) {
+        if (rank == 0)
+            cerr << "Unknown local kernel: " << kernel << endl;
+        return 1;
     }
+    GemmOptions opt = registry_gemm_options(kernel, 0);
+    if (sizes.empty())
+        sizes = {1024};
 
-    for (int n : sizes2) {
-        if (papi_enabled) {
-            ret = PAPI_start(EventSet);
-            if (ret != PAPI_OK) cout << "ERROR: Start PAPI" << endl;
-        }
-        double t = OnMultLine(n, n);
-        if (papi_enabled) {
-            ret = PAPI_stop(EventSet, values);
-            if (ret != PAPI_OK) cout << "ERROR: Stop PAPI" << endl;
-            ret = PAPI_reset(EventSet);
-            if (ret != PAPI_OK) cout << "ERROR: Reset PAPI" << endl;
-        }
-        double ops = 2.0 * (double)n * (double)n * (double)n;
-        double mflops = (ops / (t * 1.0e6));
-        WriteResult("Line_large", n, 0, 0, t, values[0], values[1], mflops, 1.0, 1.0);
+    int dims[2] = {0, 0}, periods[2] = {0, 0}, coords[2];
+    MPI_Dims_create(size, 2, dims);
+    MPI_Comm grid, rowComm, colComm;
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &grid);
+    MPI_Cart_coords(grid, rank, 2, coords);
+    int keepCol[2] = {0, 1}, keepRow[2] = {1, 0};
+    MPI_Cart_sub(grid, keepCol, &rowComm);  // rank em rowComm = coluna na grelha
+    MPI_Cart_sub(grid, keepRow, &colComm);  // rank em colComm = linha na grelha
+    int pr = dims[0], pc = dims[1], myRow = coords[0], myCol = coords[1];
+
+    string path = globalSweep.output;
+    if (path.empty())
+        path = globalSweep.json ? "metrics_cpp/mpi_cpp.jsonl" : "metrics_cpp/mpi_cpp.csv";
+    if (rank == 0) {
+        ifstream existing(path);
+        if (existing.peek() == ifstream::traits_type::eof())
+            WriteResultHeader(path, globalSweep.json);
+        cout << "SUMMA on a " << pr << " x " << pc << " grid of ranks, local kernel " << kernel << ", "
+             << omp_get_max_threads() << " threads per rank" << endl;
     }
 
-    for (int n : sizes2) {
-        for (int bs : blockSizes) {
-            int n_i = (n + bs - 1) / bs;
-            int n_k = (n + bs - 1) / bs;
-            int n_j = (n + bs - 1) / bs;
-            int totalBlocks = n_i * n_k * n_j;
-            if (papi_enabled) {
-                ret = PAPI_start(EventSet);
-                if (ret != PAPI_OK) cout << "ERROR: Start PAPI" << endl;
-            }
-            double tb = OnMultBlock(n, n, bs);
-            if (papi_enabled) {
-                ret = PAPI_stop(EventSet, values);
-                if (ret != PAPI_OK) cout << "ERROR: Stop PAPI" << endl;
-                ret = PAPI_reset(EventSet);
-                if (ret != PAPI_OK) cout << "ERROR: Reset PAPI" << endl;
+    int status = 0;
+    for (int n : sizes) {
+        int r0, mr, c0, nc;
+        block_range(n, pr, myRow, r0, mr);
+        block_range(n, pc, myCol, c0, nc);
+        // A local: linhas r0.. x colunas c0..; B local: linhas r0.. x colunas c0..; C local: mr x nc
+        double *A = alloc_aligned((size_t)mr * nc + 1);
+        double *B = alloc_aligned((size_t)mr * nc + 1);
+        double *C = alloc_aligned((size_t)mr * nc + 1);
+        for (int i = 0; i < mr; i++)
+            for (int j = 0; j < nc; j++) {
+                A[(size_t)i * nc + j] = (double)(r0 + i + 1) * (c0 + j + 1);
+                B[(size_t)i * nc + j] = (double)(r0 + i + 1 + c0 + j);
             }
-            double ops = 2.0 * (double)n * (double)n * (double)n;
-            double mflops = (ops / (tb * 1.0e6));
-            WriteResult("Block_" + to_string(bs), n, bs, totalBlocks, tb, values[0], values[1], mflops, 1.0, 1.0);
-        }
-    }
 
-    for (int n : sizes1) {
-        // External Parallel Line
-        if (papi_enabled) {
-            ret = PAPI_start(EventSet);
-            if (ret != PAPI_OK) cout << "ERROR: Start PAPI" << endl;
+        vector<SummaPanel> panels;
+        for (int k = 0; k < n;) {
+            SummaPanel p = {k, 0, block_owner(n, pc, k), block_owner(n, pr, k)};
+            int cs, cl, rs, rl;
+            block_range(n, pc, p.ownerCol, cs, cl);
+            block_range(n, pr, p.ownerRow, rs, rl);
+            p.width = min(min(k + panel, cs + cl), rs + rl) - k;
+            panels.push_back(p);
+            k += p.width;
         }
-        double tSeq = OnMultLine(n, n);
-        double tPar = OnMultLineExtParallel(n, n);
-        if (papi_enabled) {
-            ret = PAPI_stop(EventSet, values);
-            if (ret != PAPI_OK) cout << "ERROR: Stop PAPI" << endl;
-            ret = PAPI_reset(EventSet);
-            if (ret != PAPI_OK) cout << "ERROR: Reset PAPI" << endl;
-        }
-        double ops = 2.0 * (double)n * (double)n * (double)n;
-        double mflops = (ops / (tPar * 1.0e6));
-        double speedup = tSeq / tPar; 
-        double efficiency = speedup / threads;
-        WriteResult("LineExtParallel", n, 0, 0, tPar, values[0], values[1], mflops, speedup, efficiency);
-    }
+        int maxWidth = panel;
+        double *Ap[2] = {alloc_aligned((size_t)mr * maxWidth + 1), alloc_aligned((size_t)mr * maxWidth + 1)};
+        double *Bp[2] = {alloc_aligned((size_t)maxWidth * nc + 1), alloc_aligned((size_t)maxWidth * nc + 1)};
+        MPI_Request req[2][2];
 
-    for (int n : sizes2) {
-        // External Parallel Line
-        if (papi_enabled) {
-            ret = PAPI_start(EventSet);
-            if (ret != PAPI_OK) cout << "ERROR: Start PAPI" << endl;
-        }
-        double tSeq = OnMultLine(n, n);
-        double tPar = OnMultLineExtParallel(n, n);
-        if (papi_enabled) {
-            ret = PAPI_stop(EventSet, values);
-            if (ret != PAPI_OK) cout << "ERROR: Stop PAPI" << endl;
-            ret = PAPI_reset(EventSet);
-            if (ret != PAPI_OK) cout << "ERROR: Reset PAPI" << endl;
-        }
-        double ops = 2.0 * (double)n * (double)n * (double)n;
-        double mflops = (ops / (tPar * 1.0e6));
-        double speedup = tSeq / tPar; // Using previous line time as sequential reference
-        double efficiency = speedup / threads;
-        WriteResult("LineExtParallel_large", n, 0, 0, tPar, values[0], values[1], mflops, speedup, efficiency);
-    }
+        auto post = [&](size_t s) {
+            const SummaPanel &p = panels[s];
+            int b = s % 2;
+            if (myCol == p.ownerCol)
+                for (int i = 0; i < mr; i++)
+                    memcpy(Ap[b] + (size_t)i * p.width, A + (size_t)i * nc + (p.k - c0), p.width * sizeof(double));
+            if (myRow == p.ownerRow)
+                memcpy(Bp[b], B + (size_t)(p.k - r0) * nc, (size_t)p.width * nc * sizeof(double));
+            MPI_Ibcast(Ap[b], mr * p.width, MPI_DOUBLE, p.ownerCol, rowComm, &req[b][0]);
+            MPI_Ibcast(Bp[b], p.width * nc, MPI_DOUBLE, p.ownerRow, colComm, &req[b][1]);
+        };
+        // Uma multiplicação: devolve o tempo de parede e acumula computação e espera de comunicação
+        auto run = [&](double &compute, double &comm) {
+            compute = comm = 0.0;
+            MPI_Barrier(grid);
+            double start = MPI_Wtime();
+            if (!panels.empty())
+                post(0);
+            for (size_t s = 0; s < panels.size(); s++) {
+                if (s + 1 < panels.size())
+                    post(s + 1);
+                double t0 = MPI_Wtime();
+                MPI_Waitall(2, req[s % 2], MPI_STATUSES_IGNORE);
+                double t1 = MPI_Wtime();
+                gemm('N', 'N', mr, nc, panels[s].width, 1.0, Ap[s % 2], panels[s].width, Bp[s % 2], nc,
+                     s == 0 ? 0.0 : 1.0, C, nc, opt);
+                comm += t1 - t0;
+                compute += MPI_Wtime() - t1;
+            }
+            return MPI_Wtime() - start;
+        };
 
-    for (int n : sizes1) {
-        // Internal Parallel Line
-        if (papi_enabled) {
-            ret = PAPI_start(EventSet);
-            if (ret != PAPI_OK) cout << "ERROR: Start PAPI" << endl;
+        double compute, comm;
+        for (int w = 0; w < globalBench.warmup; w++)
+            run(compute, comm);
+        // Todos os processos fazem o mesmo número de repetições; cada uma vale o máximo entre processos
+        vector<double> times, computes, comms;
+        for (int r = 0; r < max(1, globalBench.reps); r++) {
+            double local[3], worst[3];
+            local[0] = run(compute, comm);
+            local[1] = compute;
+            local[2] = comm;
+            MPI_Reduce(local, worst, 3, MPI_DOUBLE, MPI_MAX, 0, grid);
+            times.push_back(worst[0]);
+            computes.push_back(worst[1]);
+            comms.push_back(worst[2]);
         }
-        double tSeq = OnMultLine(n, n);
-        double tPar = OnMultLineIntParallel(n, n);
-        if (papi_enabled) {
-            ret = PAPI_stop(EventSet, values);
-            if (ret != PAPI_OK) cout << "ERROR: Stop PAPI" << endl;
-            ret = PAPI_reset(EventSet);
-            if (ret != PAPI_OK) cout << "ERROR: Reset PAPI" << endl;
-        }
-        double ops = 2.0 * (double)n * (double)n * (double)n;
-        double mflops = (ops / (tPar * 1.0e6));
-        double speedup = tSeq / tPar; 
-        double efficiency = speedup / threads;
-        WriteResult("LineIntParallel", n, 0, 0, tPar, values[0], values[1], mflops, speedup, efficiency);
-    }
 
-    for (int n : sizes2) {
-        // Internal Parallel Line
-        if (papi_enabled) {
-            ret = PAPI_start(EventSet);
-            if (ret != PAPI_OK) cout << "ERROR: Start PAPI" << endl;
+        double sum = (double)n * (n + 1) / 2.0, sumSq = (double)n * (n + 1) * (2.0 * n + 1) / 6.0;
+        double tol = 2.0 * n * 2.220446049250313e-16;
+        int ok = 1;
+        for (int i = 0; i < mr && ok; i++)
+            for (int j = 0; j < nc; j++) {
+                double expected = (r0 + i + 1) * (sumSq + (double)(c0 + j) * sum);
+                if (fabs(C[(size_t)i * nc + j] - expected) > tol * expected) {
+                    ok = 0;
+                    break;
+                }
+            }
+        int allOk;
+        MPI_Allreduce(&ok, &allOk, 1, MPI_INT, MPI_LAND, grid);
+        if (!allOk)
+            status = 1;
+
+        if (rank == 0) {
+            string name = "SUMMA-" + kernel;
+            BenchStats st = compute_stats(times);
+            sort(computes.begin(), computes.end());
+            sort(comms.begin(), comms.end());
+            double t1 = size == 1 ? st.median : (globalSweep.json ? 0.0 : mpi_baseline_time(path, name, n, panel));
+            double speedup = t1 > 0.0 ? t1 / st.median : NAN;
+            ResultRow row = {name, n, panel, (int)panels.size(), st, CounterSample(), speedup, speedup / size,
+                             omp_get_max_threads(), 0, 0, 0, "double", NAN, allOk ? "pass" : "fail", NAN, size,
+                             computes[computes.size() / 2], comms[comms.size() / 2], 0.0};
+            WriteResultRow(path, row, globalSweep.json);
+            cout << "N=" << n << " ranks=" << size << " panels=" << panels.size() << ": time " << st.median << " s (compute "
+                 << row.computeTime << " s, comm wait " << row.commTime << " s), "
+                 << 2.0 * n * (double)n * n / (st.median * 1.0e9) << " GFlops";
+            if (!std::isnan(speedup))
+                cout << ", speedup " << speedup << ", efficiency " << speedup / size;
+            cout << (allOk ? ", verified" : ", VERIFICATION FAILED") << endl;
         }
-        double tSeq = OnMultLine(n, n);
-        double tPar = OnMultLineIntParallel(n, n);
-        if (papi_enabled) {
-            ret = PAPI_stop(EventSet, values);
-            if (ret != PAPI_OK) cout << "ERROR: Stop PAPI" << endl;
-            ret = PAPI_reset(EventSet);
-            if (ret != PAPI_OK) cout << "ERROR: Reset PAPI" << endl;
+        free(A);
+        free(B);
+        free(C);
+        for (int b = 0; b < 2; b++) {
+            free(Ap[b]);
+            free(Bp[b]);
         }
-        double ops = 2.0 * (double)n * (double)n * (double)n;
-        double mflops = (ops / (tPar * 1.0e6));
-        double speedup = tSeq / tPar;
-        double efficiency = speedup / threads;
-        WriteResult("LineIntParallel_large", n, 0, 0, tPar, values[0], values[1], mflops, speedup, efficiency);
     }
-
-    return 0;
+    if (rank == 0)
+        cout << "Results appended to " << path << endl;
+    MPI_Comm_free(&rowComm);
+    MPI_Comm_free(&colComm);
+    MPI_Comm_free(&grid);
+    return status;
 }
+#endif
 
 int main(int argc, char *argv[]) {
+#ifdef USE_MPI
+    MpiSession mpi(&argc, &argv);
+#endif
     int op, lin, col, blockSize;
-    int EventSet = PAPI_NULL;
-    long long values[2] = {0, 0};
-    int ret;
-    bool papi_enabled = true;
+    CounterSample sample;
     
+    for (int a = 1; a < argc; a++) {
+        string arg = argv[a];
+        if (arg == "--help" || arg == "-h") {
+            PrintUsage(argv[0]);
+            return 0;
+        }
+        if (arg.compare(0, 2, "--") != 0 || a + 1 >= argc || !apply_option(arg.substr(2), argv[++a])) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
     struct stat st = {0};
     if (stat("metrics_cpp", &st) == -1) {
         if (mkdir("metrics_cpp", 0777) != 0) {
@@ -485,24 +6121,89 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    if (!globalHistory.compare.empty())
+        return RunCompare(globalHistory.compare);
+
+    if (!globalMpi.algo.empty()) {
+#ifdef USE_MPI
+        return RunSumma(globalSweep.sizes, globalSweep.algorithms.empty() ? "Block" : globalSweep.algorithms[0], globalMpi.panel);
+#else
+        cerr << "--mpi needs a build with MPI: mpicxx -DUSE_MPI ..." << endl;
+        return 1;
+#endif
+    }
+#ifdef USE_MPI
+    if (mpi.size > 1) {
+        if (mpi.rank == 0)
+            cerr << "Several MPI ranks but no --mpi mode" << endl;
+        return 1;
+    }
+#endif
+
+    for (const string &spec : globalFiles.make)
+        if (!make_matrix_file(spec))
+            return 1;
+    if (!globalFiles.make.empty() && globalFiles.a.empty() && !globalSweep.enabled && globalOoc.n == 0)
+        return 0;
+
     init_papi();
+    if (!globalCounters.open())
+        cout << "PAPI counters disabled (no requested event available)" << endl;
+    if (load_profile(globalProfile))
+        cout << "Tuning profile " << profile_path() << " (" << globalProfile.entries.size() << " entries)" << endl;
     
-    ret = PAPI_create_eventset(&EventSet);
-    if (ret != PAPI_OK)
-        cout << "ERROR: create eventset" << endl;
-    
-    ret = PAPI_add_event(EventSet, PAPI_L1_DCM);
-    if (ret != PAPI_OK) {
-        cout << "ERROR: PAPI_L1_DCM (" << PAPI_strerror(ret) << ")" << endl;
-        papi_enabled = false;
+    if (globalSweep.autotune) {
+        int status = RunAutotune(globalSweep.algorithms, globalSweep.sizes);
+        globalCounters.close();
+        return status;
     }
-
-    ret = PAPI_add_event(EventSet, PAPI_L2_DCM);
-    if (ret != PAPI_OK) {
-        cout << "ERROR: PAPI_L2_DCM (" << PAPI_strerror(ret) << ")" << endl;
-        papi_enabled = false;
+    if (!globalSparseDensities.empty()) {
+        int status = RunStructured(globalSweep.sizes, globalSparseDensities);
+        globalCounters.close();
+        return status;
     }
-    
+    if (!globalService.rates.empty()) {
+        int status = RunServiceLoad(globalService.rates, globalSweep.sizes, globalService.workers, globalService.maxBatch,
+                                    globalService.requests);
+        globalCounters.close();
+        return status;
+    }
+    if (!globalEpilogues.empty()) {
+        int status = RunEpilogueBenchmark(globalSweep.algorithms, globalSweep.sizes, globalEpilogues);
+        globalCounters.close();
+        return status;
+    }
+    if (globalBatchCount > 0) {
+        int status = RunBatchBenchmark(globalSweep.sizes, globalBatchCount);
+        globalCounters.close();
+        return status;
+    }
+    if (!globalFiles.a.empty() || !globalFiles.b.empty()) {
+        int status = 1;
+        if (globalFiles.a.empty() || globalFiles.b.empty())
+            cerr << "File mode needs both --input-a and --input-b" << endl;
+        else
+            status = RunFileInputs(globalFiles.a, globalFiles.b, globalFiles.c, globalSweep.algorithms);
+        globalCounters.close();
+        return status;
+    }
+    if (globalSweep.enabled || !globalSweep.scaling.empty() || !globalSweep.roofline.empty() || globalSweep.verify == "all" || globalOoc.n > 0) {
+        int baseN = globalSweep.sizes.empty() ? 1024 : globalSweep.sizes[0];
+        int status;
+        if (globalOoc.n > 0)
+            status = RunOutOfCore(globalOoc, globalSweep.algorithms.empty() ? "BlockParallel" : globalSweep.algorithms[0], 0);
+        else if (globalSweep.verify == "all")
+            status = RunVerification(globalSweep.algorithms, globalSweep.sizes);
+        else if (!globalSweep.roofline.empty())
+            status = RunRoofline(baseN, globalSweep.roofline == "full");
+        else if (!globalSweep.scaling.empty())
+            status = RunScalingStudy(globalSweep.scaling, baseN);
+        else
+            status = RunSweep();
+        globalCounters.close();
+        return status;
+    }
+
     do {
         cout << "\nMenu:" << endl;
         cout << "1. Multiplication (Standard (sequential))" << endl;
@@ -513,8 +6214,33 @@ int main(int argc, char *argv[]) {
         cout << "6. Toggle size mode (current: " << (size_mode ? "Multiple Sizes" : "Fixed Size") << ")" << endl;
         cout << "7. Toggle output mode (current: " << (writing_to_file ? "File" : "Console") << ")" << endl;
         cout << "8. Run Automated Tests" << endl;
-        cout << "9. Set Global Block Size (current: " << globalBlockSize << ")" << endl;
+        cout << "9. Set Global Block Size (current: " << globalBlockSize << ", MC/KC/NC: " << globalMC << "/" << globalKC << "/" << globalNC << ")" << endl;
         cout << "10. Test Parallel Performance (MFlops, Speedup, Efficiency)" << endl;
+        cout << "11. SIMD Micro-kernel Multiplication (sequential)" << endl;
+        cout << "12. Block Multiplication - Packed Panels MC/KC/NC (sequential)" << endl;
+        cout << "13. Block Multiplication - Parallel Tasks (2D tiles)" << endl;
+        cout << "14. Set NUMA policy for parallel kernels (current: " << numa_policy_name(globalNuma) << ")" << endl;
+        cout << "15. Toggle huge pages for matrix arena (current: " << (globalArena.hugePages ? "On" : "Off") << ")" << endl;
+        cout << "16. Strassen Multiplication (crossover to block, tasks)" << endl;
+        cout << "17. Measure Strassen crossover and error" << endl;
+        cout << "18. Rectangular GEMM (M x K * K x N, op(A)/op(B))" << endl;
+        cout << "19. Benchmark settings (current: warmup " << globalBench.warmup << ", reps " << globalBench.reps << ", min-time " << globalBench.minTime << " s)" << endl;
+        cout << "20. Thread scaling study (strong/weak, speedup, efficiency, Karp-Flatt)" << endl;
+        cout << "21. Set PAPI events (current: " << globalCounters.activeCount() << "/" << globalCounters.requested.size()
+             << " active" << (globalCounters.multiplexed ? ", multiplexed" : "") << ")" << endl;
+        cout << "22. Toggle per-thread counters for parallel kernels (current: " << (globalPerThreadCounters ? "On" : "Off") << ")" << endl;
+        cout << "23. Roofline report (bandwidth/FMA ceilings, kernel intensity)" << endl;
+        cout << "24. Mixed precision comparison (double, float, bf16, fp16)" << endl;
+        cout << "25. Verify all algorithms (random/adversarial inputs, Freivalds for large N)" << endl;
+        cout << "26. Out-of-core multiplication (tiled files, prefetched pread/mmap)" << endl;
+        cout << "27. Multiply matrices from binary files (.cpdm)" << endl;
+        cout << "28. Autotune block size, threads and schedule (current profile: " << globalProfile.entries.size() << " entries)" << endl;
+        cout << "29. Cache-oblivious Multiplication (Morton order, recursive, tasks)" << endl;
+        cout << "30. Batched small GEMM (many independent N x N products, matrices/s)" << endl;
+        cout << "31. GEMM service under open-loop load (thread pool, p50/p99/p999 latency)" << endl;
+        cout << "32. Sparse and structured paths (CSR/BCSR, TRMM, SYMM, SYRK, auto dispatch)" << endl;
+        cout << "33. Compare two recorded runs (regression check against the result history)" << endl;
+        cout << "34. Fused epilogues (alpha/beta, bias, ReLU/GELU, clamp, down-conversion) vs a second pass" << endl;
         cout << "0. Exit" << endl;
         cout << "Selection?: ";
         cin >> op;
@@ -534,13 +6260,239 @@ int main(int argc, char *argv[]) {
             continue;
         }
         if (op == 8) {
-            RunAutomatedTests(EventSet, papi_enabled);
+            RunAutomatedTests();
             continue;
         }
         if (op == 9) {
             cout << "Enter new global block size: ";
             cin >> globalBlockSize;
             cout << "Global block size updated to " << globalBlockSize << endl;
+            cout << "Enter packed panel sizes MC (L2) KC (L1) NC (L3), 0 keeps current: ";
+            int mc, kc, nc;
+            cin >> mc >> kc >> nc;
+            if (mc > 0) globalMC = mc;
+            if (kc > 0) globalKC = kc;
+            if (nc > 0) globalNC = nc;
+            cout << "Packed panels updated to MC/KC/NC: " << globalMC << "/" << globalKC << "/" << globalNC << endl;
+            continue;
+        }
+        if (op == 34) {
+            string sizes, epilogues;
+            cout << "Sizes (e.g. 1024,2048): ";
+            cin >> sizes;
+            cout << "Epilogues (all or e.g. bias_relu,relu_bf16): ";
+            cin >> epilogues;
+            RunEpilogueBenchmark({}, parse_int_list(sizes), parse_string_list(epilogues));
+            continue;
+        }
+        if (op == 33) {
+            vector<HistoryRecord> records = load_history(globalHistory.path);
+            vector<pair<string, int>> runs;  // (run_id, linhas) por ordem de gravação
+            for (const HistoryRecord &rec : records) {
+                if (runs.empty() || runs.back().first != rec.meta.at("run_id"))
+                    runs.push_back({rec.meta.at("run_id"), 0});
+                runs.back().second++;
+            }
+            cout << "Recorded runs in " << globalHistory.path << ":" << endl;
+            for (size_t r = runs.size() > 10 ? runs.size() - 10 : 0; r < runs.size(); r++)
+                cout << "  " << runs[r].first << " (" << runs[r].second << " rows)" << endl;
+            string base, next;
+            cout << "Base run (id, git SHA prefix, latest, previous): ";
+            cin >> base;
+            cout << "New run: ";
+            cin >> next;
+            RunCompare(base + "," + next);
+            continue;
+        }
+        if (op == 32) {
+            string densities;
+            int n;
+            cout << "Matrix size: ";
+            cin >> n;
+            cout << "Densities of A (e.g. 0.01,0.05,0.1): ";
+            cin >> densities;
+            vector<double> list;
+            for (const string &d : parse_string_list(densities))
+                list.push_back(atof(d.c_str()));
+            RunStructured({n}, list);
+            continue;
+        }
+        if (op == 31) {
+            string rates, sizes;
+            cout << "Arrival rates in requests/s (e.g. 1000,10000): ";
+            cin >> rates;
+            cout << "Sizes (e.g. 8,16,32,64,128): ";
+            cin >> sizes;
+            vector<double> rateList;
+            if (!parse_rate_list(rates, rateList))
+                continue;
+            RunServiceLoad(rateList, parse_int_list(sizes), globalService.workers, globalService.maxBatch, globalService.requests);
+            continue;
+        }
+        if (op == 30) {
+            string sizes;
+            int count;
+            cout << "Sizes (e.g. 8,16,32,64): ";
+            cin >> sizes;
+            cout << "Products per batch: ";
+            cin >> count;
+            RunBatchBenchmark(parse_int_list(sizes), max(1, count));
+            continue;
+        }
+        if (op == 28) {
+            string sizes;
+            cout << "Sizes to tune (e.g. 512,1024): ";
+            cin >> sizes;
+            RunAutotune({}, parse_int_list(sizes));
+            continue;
+        }
+        if (op == 27) {
+            string a, b, c, algo;
+            cout << "File A: ";
+            cin >> a;
+            cout << "File B: ";
+            cin >> b;
+            cout << "Output file for C (- = none): ";
+            cin >> c;
+            cout << "Algorithm (e.g. Simd, BlockParallel): ";
+            cin >> algo;
+            RunFileInputs(a, b, c == "-" ? "" : c, {algo});
+            continue;
+        }
+        if (op == 26) {
+            OocConfig cfg = globalOoc;
+            string io;
+            cout << "Matrix size: ";
+            cin >> cfg.n;
+            cout << "Tile size: ";
+            cin >> cfg.tile;
+            cout << "I/O mode (pread/mmap): ";
+            cin >> io;
+            cfg.useMmap = (io == "mmap");
+            RunOutOfCore(cfg, "BlockParallel", globalBlockSize);
+            continue;
+        }
+        if (op == 25) {
+            string sizes;
+            cout << "Sizes (e.g. 31,257,1031; 0 = default set): ";
+            cin >> sizes;
+            vector<int> list = parse_int_list(sizes);
+            if (list.size() == 1 && list[0] == 0)
+                list.clear();
+            RunVerification({}, list);
+            continue;
+        }
+        if (op == 24) {
+            int n, alg;
+            cout << "Matrix size: ";
+            cin >> n;
+            cout << "Algorithm (1 Standard, 2 Line, 3 Block, 4 LineExt, 5 LineInt, 13 BlockParallel): ";
+            cin >> alg;
+            GemmAlgo algo = GEMM_LINE;
+            switch (alg) {
+                case 1: algo = GEMM_STANDARD; break;
+                case 3: algo = GEMM_BLOCK; break;
+                case 4: algo = GEMM_LINE_EXT_PARALLEL; break;
+                case 5: algo = GEMM_LINE_INT_PARALLEL; break;
+                case 13: algo = GEMM_BLOCK_PARALLEL; break;
+                default: algo = GEMM_LINE; break;
+            }
+            ComparePrecisions(n, algo, globalBlockSize);
+            continue;
+        }
+        if (op == 23) {
+            int n;
+            cout << "Matrix size for the kernels (0 = ceilings only): ";
+            cin >> n;
+            RunRoofline(n, n > 0);
+            continue;
+        }
+        if (op == 22) {
+            globalPerThreadCounters = !globalPerThreadCounters;
+            cout << "Per-thread counters toggled to: " << (globalPerThreadCounters ? "On" : "Off") << endl;
+            continue;
+        }
+        if (op == 21) {
+            string events;
+            cout << "Comma-separated PAPI events (e.g. PAPI_TOT_CYC,PAPI_TOT_INS,PAPI_DP_OPS,PAPI_L3_TCM,PAPI_TLB_DM): ";
+            cin >> events;
+            globalCounters.requested = parse_string_list(events);
+            if (!globalCounters.open())
+                cout << "PAPI counters disabled (no requested event available)" << endl;
+            continue;
+        }
+        if (op == 20) {
+            int baseN;
+            string mode;
+            cout << "Base N: ";
+            cin >> baseN;
+            cout << "Mode (strong/weak/both): ";
+            cin >> mode;
+            if (mode != "strong" && mode != "weak")
+                mode = "both";
+            RunScalingStudy(mode, baseN);
+            continue;
+        }
+        if (op == 19) {
+            cout << "Warmup runs, measured repetitions, min-time in seconds (0 = off): ";
+            cin >> globalBench.warmup >> globalBench.reps >> globalBench.minTime;
+            globalBench.warmup = max(0, globalBench.warmup);
+            globalBench.reps = max(1, globalBench.reps);
+            continue;
+        }
+        if (op == 18) {
+            int M, N, K, alg;
+            char transA, transB;
+            cout << "M K N: ";
+            cin >> M >> K >> N;
+            cout << "op(A) op(B) (N = normal, T = transposed): ";
+            cin >> transA >> transB;
+            cout << "Algorithm (1 Standard, 2 Line, 3 Block, 4 LineExt, 5 LineInt, 11 Simd, 13 BlockParallel, 16 Strassen, 29 Morton): ";
+            cin >> alg;
+            GemmAlgo algo = GEMM_SIMD;
+            switch (alg) {
+                case 1: algo = GEMM_STANDARD; break;
+                case 2: algo = GEMM_LINE; break;
+                case 3: algo = GEMM_BLOCK; break;
+                case 4: algo = GEMM_LINE_EXT_PARALLEL; break;
+                case 5: algo = GEMM_LINE_INT_PARALLEL; break;
+                case 13: algo = GEMM_BLOCK_PARALLEL; break;
+                case 16: algo = GEMM_STRASSEN; break;
+                case 29: algo = GEMM_MORTON; break;
+                default: algo = GEMM_SIMD; break;
+            }
+            double elapsed = OnMultRect(M, N, K, transA, transB, algo);
+            PrintOrWriteResults(string("Rect_") + gemm_algo_name(algo), M, 0, 0, elapsed, 0, 0);
+            continue;
+        }
+        if (op == 17) {
+            cout << "Largest N to test (power of 2): ";
+            int maxN;
+            cin >> maxN;
+            MeasureStrassenCrossover(maxN);
+            continue;
+        }
+        if (op == 15) {
+            globalArena.hugePages = !globalArena.hugePages;
+            globalArena.release();
+            cout << "Huge pages toggled to: " << (globalArena.hugePages ? "On" : "Off") << endl;
+            continue;
+        }
+        if (op == 14) {
+            const NumaTopology &topo = numa_topology();
+            cout << "Detected " << topo.numNodes << " NUMA node(s), " << topo.cpus.size() << " CPU(s)" << endl;
+            char answer;
+            cout << "Parallel first-touch initialization? (y/n): ";
+            cin >> answer;
+            globalNuma.firstTouch = (answer == 'y' || answer == 'Y');
+            cout << "Thread binding (0 = none, 1 = close, 2 = spread): ";
+            cin >> globalNuma.bind;
+            if (globalNuma.bind < BIND_NONE || globalNuma.bind > BIND_SPREAD)
+                globalNuma.bind = BIND_NONE;
+            cout << "Replicate B per NUMA node? (y/n): ";
+            cin >> answer;
+            globalNuma.replicateB = (answer == 'y' || answer == 'Y');
+            cout << "NUMA policy set to: " << numa_policy_name(globalNuma) << endl;
             continue;
         }
         if (op == 10) {
@@ -550,6 +6502,7 @@ int main(int argc, char *argv[]) {
             cin >> nTest;
             TestParallelPerformance(nTest, OnMultLine, OnMultLineExtParallel, "LineExt");
             TestParallelPerformance(nTest, OnMultLine, OnMultLineIntParallel, "LineInt");
+            TestParallelPerformance(nTest, globalBlockSize, OnMultBlock, OnMultBlockParallel, "BlockParallel");
             continue;
         }
 
@@ -572,76 +6525,104 @@ int main(int argc, char *argv[]) {
             lin = s;
             col = s;
             double elapsed = 0.0;
-            if (papi_enabled) {
-                ret = PAPI_start(EventSet);
-                if (ret != PAPI_OK)
-                    cout << "ERROR: Start PAPI" << endl;
-            }
+            function<double()> run;
             switch (op) {
                 case 1:
                     algorithm = "Standard";
-                    elapsed = OnMult(lin, col);
+                    run = [=] { return OnMult(lin, col); };
                     break;
                 case 2:
                     algorithm = "Line";
-                    elapsed = OnMultLine(lin, col);
+                    run = [=] { return OnMultLine(lin, col); };
                     break;
-                case 3: {
-                    algorithm = "Block";
-                    cout << "Use global block size (" << globalBlockSize << ")? (y/n): ";
+                case 3:
+                case 13: {
+                    algorithm = (op == 3) ? "Block" : "BlockParallel";
+                    GemmOptions tuned = tuned_options(op == 3 ? GEMM_BLOCK : GEMM_BLOCK_PARALLEL, lin);
+                    cout << "Use " << (find_tuned(algorithm, lin) ? "tuned" : "global") << " block size (" << tuned.bkSize << ")? (y/n): ";
                     char useGlobal;
                     cin >> useGlobal;
+                    int bkArg = 0;  // 0: perfil de afinação ou bloco global
                     if (useGlobal == 'n' || useGlobal == 'N') {
                         cout << "Enter block size: ";
                         cin >> blockSize;
+                        bkArg = blockSize;
                     } else {
-                        blockSize = globalBlockSize;
+                        blockSize = tuned.bkSize;
                     }
-                    int n_i = (lin + blockSize - 1) / blockSize;
+                    int n_i = (lin + (bkArg > 0 || tuned.bm <= 0 ? blockSize : tuned.bm) - 1) / (bkArg > 0 || tuned.bm <= 0 ? blockSize : tuned.bm);
                     int n_k = (lin + blockSize - 1) / blockSize;
-                    int n_j = (col + blockSize - 1) / blockSize;
+                    int n_j = (col + (bkArg > 0 || tuned.bn <= 0 ? blockSize : tuned.bn) - 1) / (bkArg > 0 || tuned.bn <= 0 ? blockSize : tuned.bn);
                     totalBlocks = n_i * n_k * n_j;
-                    elapsed = OnMultBlock(lin, col, blockSize);
+                    if (op == 3)
+                        run = [=] { return OnMultBlock(lin, col, bkArg); };
+                    else
+                        run = [=] { return OnMultBlockParallel(lin, col, bkArg); };
                     }
                     break;
                 case 4:
                     algorithm = "LineExtParallel";
-                    elapsed = OnMultLineExtParallel(lin, col);
+                    run = [=] { return OnMultLineExtParallel(lin, col); };
                     break;
                 case 5:
                     algorithm = "LineIntParallel";
-                    elapsed = OnMultLineIntParallel(lin, col);
+                    run = [=] { return OnMultLineIntParallel(lin, col); };
+                    break;
+                case 11:
+                    algorithm = "Simd";
+                    run = [=] { return OnMultSimd(lin, col); };
+                    break;
+                case 16: {
+                    algorithm = "Strassen";
+                    cout << "Use crossover size (" << strassenCrossover << ")? (y/n): ";
+                    char useGlobal;
+                    cin >> useGlobal;
+                    if (useGlobal == 'n' || useGlobal == 'N') {
+                        cout << "Enter crossover size: ";
+                        int crossover;
+                        cin >> crossover;
+                        if (crossover >= 1)
+                            strassenCrossover = crossover;
+                        else
+                            cout << "Crossover must be at least 1, keeping " << strassenCrossover << endl;
+                    }
+                    int levels, leaf;
+                    strassen_plan(lin, strassenCrossover, levels, leaf);
+                    print_strassen_plan(lin, strassenCrossover);
+                    totalBlocks = (int)pow(7.0, levels);
+                    run = [=] { return OnMultStrassen(lin, col, strassenCrossover); };
+                    }
+                    break;
+                case 29: {
+                    algorithm = "Morton";
+                    int levels, leaf;
+                    strassen_plan(lin, MORTON_LEAF, levels, leaf);
+                    blockSize = leaf;
+                    totalBlocks = 1 << (3 * levels);
+                    run = [=] { return OnMultMorton(lin, col); };
+                    }
+                    break;
+                case 12:
+                    algorithm = "BlockPacked";
+                    blockSize = globalKC;
+                    totalBlocks = ((lin + globalMC - 1) / globalMC) * ((lin + globalKC - 1) / globalKC) * ((col + globalNC - 1) / globalNC);
+                    run = [=] { return OnMultBlockPacked(lin, col, globalMC, globalKC, globalNC); };
                     break;
                 default:
                     cout << "Invalid option." << endl;
                     break;
             }
-            if (papi_enabled) {
-                ret = PAPI_stop(EventSet, values);
-                if (ret != PAPI_OK)
-                    cout << "ERROR: Stop PAPI" << endl;
-                printf("L1 DCM: %lld \n", values[0]);
-                printf("L2 DCM: %lld \n", values[1]);
-                ret = PAPI_reset(EventSet);
-                if (ret != PAPI_OK)
-                    cout << "FAIL reset" << endl;
+            if (run) {
+                bool parallel = (op == 4 || op == 5 || op == 13 || op == 16 || op == 29);
+                elapsed = RunBenchmark(run, &sample, parallel).median;
+                PrintCounters(sample, 2.0 * lin * lin * col);
             }
-            if (op >= 1 && op <= 5)
-                PrintOrWriteResults(algorithm, s, blockSize, totalBlocks, elapsed, values[0], values[1]);
+            if ((op >= 1 && op <= 5) || (op >= 11 && op <= 13) || op == 16 || op == 29)
+                PrintOrWriteResults(algorithm, s, blockSize, totalBlocks, elapsed, max(0LL, sample.get("PAPI_L1_DCM")), max(0LL, sample.get("PAPI_L2_DCM")));
         }
     } while(op != 0);
     
-    if (papi_enabled) {
-        ret = PAPI_remove_event(EventSet, PAPI_L1_DCM);
-        if (ret != PAPI_OK)
-            cout << "FAIL remove event" << endl;
-        ret = PAPI_remove_event(EventSet, PAPI_L2_DCM);
-        if (ret != PAPI_OK)
-            cout << "FAIL remove event" << endl;
-        ret = PAPI_destroy_eventset(&EventSet);
-        if (ret != PAPI_OK)
-            cout << "FAIL destroy" << endl;
-    }
+    globalCounters.close();
     
     return 0;
 }
@@ -2,6 +2,7 @@ import pandas as pd
 import matplotlib.pyplot as plt
 import numpy as np
 import os
+import re
 
 def load_data():
     cs_path = "metrics_cs/results_cs.csv"
@@ -452,6 +453,94 @@ def plot_parallel_efficiency(cpp_data, save_path="plots"):
     
     print(f"Plot saved to {save_path}/parallel_efficiency.png")
 
+def plot_roofline(save_path="plots"):
+    """Roofline: measured bandwidth/FMA ceilings with each kernel placed at its operational intensity"""
+    ceil_path = "metrics_cpp/roofline_ceilings_cpp.csv"
+    roof_path = "metrics_cpp/roofline_cpp.csv"
+    if not os.path.exists(ceil_path) or not os.path.exists(roof_path):
+        print("Roofline data not available (run lab1 with --roofline full).")
+        return
+
+    ceilings = pd.read_csv(ceil_path)
+    kernels = pd.read_csv(roof_path)
+    os.makedirs(save_path, exist_ok=True)
+
+    for threads in sorted(kernels['threads'].unique()):
+        ceil = ceilings[ceilings['threads'] == threads]
+        data = kernels[kernels['threads'] == threads]
+        peak = ceil[ceil['ceiling'] == 'peak']['value'].iloc[0]
+
+        plt.figure(figsize=(12, 8))
+        intensity = np.logspace(-3, 3, 200)
+        for level, style in [('L1', ':'), ('L2', '-.'), ('L3', '--'), ('DRAM', '-')]:
+            bw = ceil[ceil['ceiling'] == level]['value']
+            if bw.empty:
+                continue
+            plt.plot(intensity, np.minimum(peak, intensity * bw.iloc[0]), style,
+                     label=f'{level} roof ({bw.iloc[0]:.1f} GB/s)')
+        plt.axhline(y=peak, color='k', alpha=0.3)
+
+        markers = {'L2': 's', 'L3': '^', 'DRAM': 'o'}
+        for algorithm in data['algorithm'].unique():
+            rows = data[data['algorithm'] == algorithm]
+            for _, row in rows.iterrows():
+                plt.plot(row['intensity'], row['achieved'], markers.get(row['level'], 'x'),
+                         label=f"{algorithm} ({row['level']})")
+
+        plt.xscale('log')
+        plt.yscale('log')
+        plt.title(f'Roofline ({threads} thread(s), peak {peak:.1f} GFLOP/s)')
+        plt.xlabel('Operational Intensity (FLOP/byte)')
+        plt.ylabel('Performance (GFLOP/s)')
+        plt.grid(True, which='both', alpha=0.3)
+        plt.legend(fontsize='small', ncol=2)
+
+        file_name = f"roofline_{threads}t.png"
+        plt.savefig(os.path.join(save_path, file_name))
+        plt.close()
+
+        print(f"Plot saved to {save_path}/{file_name}")
+
+def plot_history(save_path="plots"):
+    """Historical trends: MFLOPS of each kernel/size across the runs recorded in the result history"""
+    hist_path = "metrics_cpp/history_cpp.csv"
+    if not os.path.exists(hist_path):
+        print("History not available (every lab1 run appends to metrics_cpp/history_cpp.csv).")
+        return
+
+    history = pd.read_csv(hist_path)
+    os.makedirs(save_path, exist_ok=True)
+
+    runs = history.drop_duplicates('run_id').sort_values('timestamp')
+    run_index = {run_id: i for i, run_id in enumerate(runs['run_id'])}
+    labels = [f"{sha}\n{ts[:16].replace('T', ' ')}" for sha, ts in zip(runs['git_sha'], runs['timestamp'])]
+    history['run'] = history['run_id'].map(run_index)
+
+    for (source, algorithm, dtype), data in history.groupby(['source', 'algorithm', 'dtype']):
+        if data['run'].nunique() < 2:
+            continue
+        plt.figure(figsize=(12, 8))
+        for (size, block, blocks, threads), rows in data.groupby(['size', 'blockSize', 'numBlocks', 'threads']):
+            rows = rows.sort_values('run').drop_duplicates('run', keep='last')
+            err = rows['mflops'] * rows['ci95'] / rows['median']
+            label = (f"N={size}" + (f", block={block}" if block > 0 else "")
+                     + (f", batch={blocks}" if source == 'batch_cpp' else "") + f", {threads} thread(s)")
+            plt.errorbar(rows['run'], rows['mflops'], yerr=err, marker='o', capsize=3, label=label)
+
+        plt.xticks(range(len(labels)), labels, rotation=45, ha='right', fontsize='small')
+        plt.title(f'Performance History: {algorithm} ({dtype}, {source})')
+        plt.xlabel('Run (git SHA, date)')
+        plt.ylabel('MFLOPS')
+        plt.grid(True, alpha=0.3)
+        plt.legend(fontsize='small')
+        plt.tight_layout()
+
+        file_name = re.sub(r'[^A-Za-z0-9_.-]', '_', f"history_{source}_{algorithm}_{dtype}") + ".png"
+        plt.savefig(os.path.join(save_path, file_name))
+        plt.close()
+
+        print(f"Plot saved to {save_path}/{file_name}")
+
 def custom_plot_menu(cs_data, cpp_data):
     save_path = input("Enter directory to save plots (default: 'plots'): ") or "plots"
     
@@ -467,6 +556,8 @@ def custom_plot_menu(cs_data, cpp_data):
         print("8. Generate All Basic Plots")
         print("9. Generate All Advanced Plots (MFLOPS, Cache misses)")
         print("10. Generate All Plots")
+        print("11. Roofline (ceilings and kernel intensity)")
+        print("12. Historical trends (MFLOPS per kernel across recorded runs)")
         print("0. Exit")
         
         choice = input("\nEnter your choice: ")
@@ -502,6 +593,12 @@ def custom_plot_menu(cs_data, cpp_data):
             plot_mflops_comparison(cpp_data, save_path)
             plot_cache_misses(cpp_data, save_path)
             plot_parallel_efficiency(cpp_data, save_path)
+            plot_roofline(save_path)
+            plot_history(save_path)
+        elif choice == '11':
+            plot_roofline(save_path)
+        elif choice == '12':
+            plot_history(save_path)
         elif choice == '0':
             break
         else: